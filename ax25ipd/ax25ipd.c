@@ -46,6 +46,11 @@ struct ax25ipd_stats stats;	/* Usage statistics */
 
 int dual_port;			/* addition for dual port flag */
 
+union peer_addr mcast_group;	/* multicast group for broadcasts, if any */
+int mcast_ttl;			/* hop limit for multicast broadcasts */
+char mcast_dev[16];		/* interface to use for the group */
+int max_frame;			/* largest AX.25 frame, CRC included */
+
 static jmp_buf restart_env;
 
 static int opt_version;
@@ -98,20 +103,27 @@ static void do_stats(void)
 	printf("           too big:  %d\n", stats.kiss_toobig);
 	printf("          bad type:  %d\n", stats.kiss_badtype);
 	printf("         too short:  %d\n", stats.kiss_tooshort);
+	printf("       bad address:  %d\n", stats.kiss_badaddr);
 	printf("        not for me:  %d\n", stats.kiss_not_for_me);
 	printf("  I am destination:  %d\n", stats.kiss_i_am_dest);
 	printf("    no route found:  %d\n", stats.kiss_no_ip_addr);
 	printf("UDP  input packets:  %d\n", stats.udp_in);
+	printf("           too big:  %d\n", stats.udp_toobig);
 	printf("IP   input packets:  %d\n", stats.ip_in);
+	printf("           too big:  %d\n", stats.ip_toobig);
 	printf("   failed CRC test:  %d\n", stats.ip_failed_crc);
 	printf("         too short:  %d\n", stats.ip_tooshort);
+	printf("       bad address:  %d\n", stats.ip_badaddr);
 	printf("        not for me:  %d\n", stats.ip_not_for_me);
 	printf("  I am destination:  %d\n", stats.ip_i_am_dest);
 	printf("\nOutput stats:\n");
 	printf("KISS output packets: %d\n", stats.kiss_out);
 	printf("            beacons: %d\n", stats.kiss_beacon_outs);
 	printf("UDP  output packets: %d\n", stats.udp_out);
+	printf("   multicast bcasts: %d\n", stats.mcast_out);
 	printf("IP   output packets: %d\n", stats.ip_out);
+	printf("    no IPv6 socket:  %d\n", stats.ip6_nosock);
+	printf("BPQ  too big:        %d\n", stats.bpq_toobig);
 	printf("\n");
 
 	fflush(stdout);
@@ -41,6 +41,18 @@
 #define DEFAULT_UDP_PORT 10093
 
 #include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/*
+ * An AXIP/AXUDP peer, IPv4 or IPv6.  The port is zero for raw AXIP.
+ * Routes keep one of these ready to be handed to sendto().
+ */
+union peer_addr {
+  struct sockaddr sa;
+  struct sockaddr_in sin;
+  struct sockaddr_in6 sin6;
+};
 
 extern int udp_mode;              /* true if we need a UDP socket */
 extern int ip_mode;               /* true if we need the raw IP socket */
@@ -60,6 +72,10 @@ extern int digi;        /* True if we are connected to a TNC */
 extern int loglevel;    /* Verbosity level */
 /* addition for dual port flag */
 extern int dual_port;
+extern union peer_addr mcast_group; /* multicast group for broadcasts */
+extern int mcast_ttl;              /* hop limit for multicast broadcasts */
+extern char mcast_dev[16];         /* interface to use for the group */
+extern int max_frame;              /* largest AX.25 frame, CRC included */
 
 struct ax25ipd_stats {
   int kiss_in;          /* # packets received */
@@ -68,22 +84,31 @@ struct ax25ipd_stats {
   int kiss_out;         /* # packets sent */
   int kiss_beacon_outs; /* # of beacons sent */
   int kiss_tooshort;    /* packet too short to be a valid frame */
+  int kiss_badaddr;     /* address field runs off the end of the frame */
   int kiss_not_for_me;  /* packet not for me (in digi mode) */
   int kiss_i_am_dest;   /* I am destination (in digi mode) */
   int kiss_no_ip_addr;  /* Couldn't find an IP addr for this call */
   int udp_in;           /* # packets received */
+  int udp_toobig;       /* packet larger than framesize */
   int udp_out;          /* # packets sent */
+  int mcast_out;        /* # broadcasts sent to the multicast group */
   int ip_in;            /* # packets received */
+  int ip_toobig;        /* packet larger than framesize */
   int ip_out;           /* # packets sent */
+  int ip6_nosock;       /* for an IPv6 peer, but no IPv6 socket */
   int ip_failed_crc;    /* from ip, but failed CRC check */
   int ip_tooshort;      /* packet too short to be a valid frame */
+  int ip_badaddr;       /* address field runs off the end of the frame */
   int ip_not_for_me;    /* packet not for me (in digi mode) */
   int ip_i_am_dest;     /* I am destination (in digi mode) */
+  int bpq_toobig;       /* bpqether packet larger than framesize */
 };
 
 extern struct ax25ipd_stats stats;
 
-#define MAX_FRAME 2048
+#define MAX_FRAME 2048     /* default framesize */
+#define MIN_FRAMESIZE 64
+#define MAX_FRAMESIZE 65535
 
 extern void LOGLn(int level, const char *str, ...);
 
@@ -94,12 +119,18 @@ extern void LOGLn(int level, const char *str, ...);
 
 #define AXRT_BCAST 1
 #define AXRT_DEFAULT 2
+#define AXRT_MCAST 4	/* peer listens on the multicast group */
+#define AXRT_LEARN 8	/* follow the peer's source address */
+
+/* me_match() result bit for a KISS port */
+#define ME_PORT(p) (1U << (p))
 
 /* start external prototypes */
 /* end external prototypes */
 
 /* kiss.c */
 void kiss_init(void);
+void kiss_buffers(unsigned char *, unsigned char *);
 void assemble_kiss(unsigned char *, int);
 void send_kiss(unsigned char, unsigned char *, int);
 void param_add(int, int);
@@ -109,9 +140,11 @@ void send_params(void);
 
 /* routing.c */
 void route_init(void);
-void route_add(unsigned char *, unsigned char *, int, unsigned int);
+void route_add(union peer_addr *, unsigned char *, int, unsigned int);
+void route_learn(unsigned char *, union peer_addr *);
+void route_check_v6(int, int);
 void bcast_add(unsigned char *);
-unsigned char *call_to_ip(unsigned char *);
+union peer_addr *call_to_ip(unsigned char *);
 int is_call_bcast(unsigned char *);
 void send_broadcast(unsigned char *, int);
 void dump_routes(void);
@@ -127,11 +160,14 @@ void dump_config(void);
 /* process.c */
 void process_init(void);
 void from_kiss(unsigned char *, int);
-void from_ip(unsigned char *, int);
+void from_ip(unsigned char *, int, union peer_addr *);
 /* void do_broadcast(void);  where did this go ?? xxx */
 void do_beacon(void);
 int addrmatch(unsigned char *, unsigned char *);
-unsigned char *next_addr(unsigned char *);
+int me_alias_add(unsigned char *, int);
+void me_compile(void);
+unsigned int me_match(unsigned char *);
+unsigned char *next_addr(unsigned char *, int);
 void add_crc(unsigned char *, int);
 void dump_ax25frame(char *, unsigned char *, int);
 
@@ -139,7 +175,11 @@ void dump_ax25frame(char *, unsigned char *, int);
 void io_init(void);
 void io_open(void);
 void io_start(void);
-void send_ip(unsigned char *, int, unsigned char *);
+void send_ip(unsigned char *, int, union peer_addr *);
+int send_mcast(unsigned char *, int);
+char *peer_to_a(union peer_addr *);
+socklen_t peer_len(union peer_addr *);
+int peer_port(union peer_addr *);
 void send_tty(unsigned char *, int);
 
 /* crc.c */
@@ -155,6 +195,7 @@ extern int ttyfd;
 /* bpqether.c */
 int send_bpq(unsigned char *buf, int len);
 int receive_bpq(unsigned char *buf, int l);
+void bpq_buffer(unsigned char *buf);
 int open_ethertap(char *ifname);
 int set_bpq_dev_call_and_up(char *ethertap_name);
 
@@ -42,29 +42,32 @@
 #define ETAP_MTU_MIN    256
 #define ETAP_MTU        1024
 #define ETAP_MTU_MAX    1500
-#ifndef	MAX_FRAME
-#define MAX_FRAME       2048
-#endif
 
 #define ETHERTAP_HEADER_LEN_TUN		18
 #define ETHERTAP_HEADER_LEN_ETHERTAP	16
 #define	ETHERTAP_HEADER_LEN_MAX	ETHERTAP_HEADER_LEN_TUN
 
-struct ethertap_packet {
-	char ethernet_header[18];
-	char data[MAX_FRAME];
-};
+/* 18 bytes ethernet header, 2 length bytes, max_frame bytes of data */
+static unsigned char *ethertap_packet;
 
 static unsigned char hwaddr_remote[6];
 
-static int ethertap_header_len;
+/* until open_ethertap() knows which kind of device it has */
+static int ethertap_header_len = ETHERTAP_HEADER_LEN_ETHERTAP;
+
+/*---------------------------------------------------------------------------*/
+
+void bpq_buffer(unsigned char *buf)
+{
+	ethertap_packet = buf;
+}
 
 /*---------------------------------------------------------------------------*/
 
 int send_bpq(unsigned char *buf, int l)
 {
-	struct ethertap_packet ethertap_packet;
-	void *addr = &ethertap_packet;
+	unsigned char *addr = ethertap_packet;
+	unsigned char *data = ethertap_packet + ETHERTAP_HEADER_LEN_MAX;
 	int offset = ETHERTAP_HEADER_LEN_MAX - ethertap_header_len;
 
 	static const unsigned char ethernet_header[18] = {
@@ -79,18 +82,21 @@ p module) */
 	if (l <= 0)
 		return -1;
 
-	if (l > (sizeof(ethertap_packet.data) - 2))
-		l = sizeof(ethertap_packet.data);
-	memcpy(ethertap_packet.data + 2, buf, l);
-	memcpy(ethertap_packet.ethernet_header, (const char *) ethernet_header, sizeof(ethernet_header));
-	memcpy(ethertap_packet.ethernet_header + 4, hwaddr_remote, 6);
-	memcpy(ethertap_packet.ethernet_header + 4 + 6 + 2, hwaddr_remote +2, 6 -2);
-	ethertap_packet.data[0] = (l + 5) % 256;
-	ethertap_packet.data[1] = (l + 5) / 256;
+	if (l > max_frame) {
+		stats.bpq_toobig++;
+		LOGL2("send_bpq: dumped - frame too large\n");
+		return -1;
+	}
+	memcpy(data + 2, buf, l);
+	memcpy(addr, ethernet_header, sizeof(ethernet_header));
+	memcpy(addr + 4, hwaddr_remote, 6);
+	memcpy(addr + 4 + 6 + 2, hwaddr_remote +2, 6 -2);
+	data[0] = (l + 5) % 256;
+	data[1] = (l + 5) / 256;
 	l += 2;
 
-	/*send_tty(addr + offset, l + sizeof(ethertap_packet.ethernet_header) - offset);*/
-	write(ttyfd, addr + offset, l + sizeof(ethertap_packet.ethernet_header) - offset);
+	/*send_tty(addr + offset, l + sizeof(ethernet_header) - offset);*/
+	write(ttyfd, addr + offset, l + sizeof(ethernet_header) - offset);
 	return l;
 }
 
@@ -98,6 +104,8 @@ p module) */
 
 int receive_bpq(unsigned char *buf, int l)
 {
+	int len;
+
 	if ((l -= ethertap_header_len) <= 0 ||
 	    (buf[ethertap_header_len-2] & 0xff) != 0x08 ||
 	    (buf[ethertap_header_len-1] & 0xff) != 0xff) {
@@ -108,10 +116,25 @@ int receive_bpq(unsigned char *buf, int l)
 		return -1;
 	}
 	l -= 2;
-	if (l <= 0 && buf[ethertap_header_len] + buf[ethertap_header_len] * 256 - 5 != l) {
+	if (l <= 0) {
+		/* no room for the length bytes or any data */
+		return 0;
+	}
+	len = buf[ethertap_header_len] + buf[ethertap_header_len + 1] * 256 - 5;
+	/* ethernet may pad short packets, so l can exceed len */
+	if (len <= 0) {
 		/* length error in bpqether packet  */
 		return 0;
 	}
+	/* from_kiss() appends the CRC in place */
+	if (len + 2 > max_frame) {
+		stats.bpq_toobig++;
+		LOGL2("receive_bpq: dumped - frame too large\n");
+		return 0;
+	}
+	if (len > l)
+		return 0;
+	l = len;
 
 	from_kiss(buf + ethertap_header_len + 2, l);
 	return l;
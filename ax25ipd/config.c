@@ -54,24 +54,35 @@ void config_init(void)
 	udp_mode = 0;
 	ip_mode = 0;
 	dual_port = 0;
+	memset(&mcast_group, 0, sizeof(mcast_group));
+	mcast_ttl = 1;
+	*mcast_dev = '\0';
+	max_frame = MAX_FRAME;
 
 	stats.kiss_in = 0;
 	stats.kiss_toobig = 0;
 	stats.kiss_badtype = 0;
 	stats.kiss_tooshort = 0;
+	stats.kiss_badaddr = 0;
 	stats.kiss_not_for_me = 0;
 	stats.kiss_i_am_dest = 0;
 	stats.kiss_no_ip_addr = 0;
 	stats.kiss_out = 0;
 	stats.kiss_beacon_outs = 0;
 	stats.udp_in = 0;
+	stats.udp_toobig = 0;
 	stats.udp_out = 0;
+	stats.mcast_out = 0;
 	stats.ip_in = 0;
+	stats.ip_toobig = 0;
 	stats.ip_out = 0;
+	stats.ip6_nosock = 0;
 	stats.ip_failed_crc = 0;
 	stats.ip_tooshort = 0;
+	stats.ip_badaddr = 0;
 	stats.ip_not_for_me = 0;
 	stats.ip_i_am_dest = 0;
+	stats.bpq_toobig = 0;
 }
 
 /* Open and read the config file */
@@ -124,6 +135,12 @@ void config_read(char *f)
 					"Bad option - every/after\n");
 			else if (e == -9)
 				fprintf(stderr, "Bad option - ip/udp\n");
+			else if (e == -10)
+				fprintf(stderr, "Too many aliases\n");
+			else if (e == -11)
+				fprintf(stderr, "Not a multicast group\n");
+			else if (e == -12)
+				fprintf(stderr, "Frame size out of range\n");
 			else
 				fprintf(stderr, "Unknown error\n");
 			fprintf(stderr, "%s", cbuf);
@@ -143,6 +160,11 @@ void config_read(char *f)
 		exit(1);
 	}
 
+	if (mcast_group.sa.sa_family != AF_UNSPEC && udp_mode == 0) {
+		fprintf(stderr, "multicast needs a udp socket\n");
+		exit(1);
+	}
+
 	if (digi) {
 		if (mycallsign[0] == '\0') {
 			fprintf(stderr, "No mycall line in config file\n");
@@ -157,14 +179,46 @@ void config_read(char *f)
 		}
 	}
 	fclose(cf);
+
+	me_compile();
+}
+
+/*
+ * Resolve a host name or numeric IPv4/IPv6 address.  A name with both
+ * kinds of address resolves to IPv4, as it always did; IPv6 is used if
+ * the name has no IPv4 address or this host has no IPv4 configured.
+ */
+static int a_to_peer(char *host, union peer_addr *pa)
+{
+	struct addrinfo hints, *res, *ai;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+	if (getaddrinfo(host, NULL, &hints, &res) != 0) {
+		/* no address configured yet, e.g. before the network is up */
+		hints.ai_flags = 0;
+		if (getaddrinfo(host, NULL, &hints, &res) != 0)
+			return -1;
+	}
+	for (ai = res; ai; ai = ai->ai_next)
+		if (ai->ai_family == AF_INET)
+			break;
+	if (ai == NULL)
+		ai = res;
+	memset(pa, 0, sizeof(*pa));
+	memcpy(pa, ai->ai_addr, ai->ai_addrlen);
+	freeaddrinfo(res);
+	return 0;
 }
 
 /* Process each line from the config file.  The return value is encoded. */
 int parse_line(char *buf)
 {
 	char *p, *q;
-	unsigned char tcall[7], tip[4];
-	struct hostent *he;
+	unsigned char tcall[7];
+	union peer_addr tip;
 	int i, j, uport;
 	unsigned int flags;
 
@@ -201,6 +255,13 @@ int parse_line(char *buf)
 		if (mycallsign2[0] == '\0') {
 			dual_port = 0;
 		}
+		/* any further aliases on the line go to the same port */
+		while ((q = strtok(NULL, " \t\n\r")) != NULL) {
+			if (a_to_call(q, tcall) != 0)
+				return -2;
+			if (me_alias_add(tcall, 0) != 0)
+				return -10;
+		}
 		return 0;
 
 	} else if (strcmp(p, "myalias2") == 0) {
@@ -209,6 +270,12 @@ int parse_line(char *buf)
 			return -1;
 		if (a_to_call(q, myalias2) != 0)
 			return -2;
+		while ((q = strtok(NULL, " \t\n\r")) != NULL) {
+			if (a_to_call(q, tcall) != 0)
+				return -2;
+			if (me_alias_add(tcall, 1) != 0)
+				return -10;
+		}
 		return 0;
 
 	} else if (strcmp(p, "device") == 0) {
@@ -314,6 +381,15 @@ int parse_line(char *buf)
 		loglevel = atoi(q);
 		return 0;
 
+	} else if (strcmp(p, "framesize") == 0) {
+		q = strtok(NULL, " \t\n\r");
+		if (q == NULL)
+			return -1;
+		max_frame = atoi(q);
+		if (max_frame < MIN_FRAMESIZE || max_frame > MAX_FRAMESIZE)
+			return -12;
+		return 0;
+
 	} else if (strcmp(p, "route") == 0) {
 		uport = 0;
 		flags = 0;
@@ -328,15 +404,8 @@ int parse_line(char *buf)
 		q = strtok(NULL, " \t\n\r");
 		if (q == NULL)
 			return -1;
-		he = gethostbyname(q);
-		if (he != NULL) {
-			memcpy(tip, he->h_addr_list[0], 4);
-		} else {	/* maybe user specified a numeric addr? */
-			j = inet_addr(q);
-			if (j == -1)
-				return -5;	/* if -1, bad deal! */
-			memcpy(tip, &j, 4);
-		}
+		if (a_to_peer(q, &tip) != 0)
+			return -5;
 
 		if (my_udp)
 			uport = ntohs(my_udp);
@@ -370,9 +439,19 @@ int parse_line(char *buf)
 				if (strchr(q, 'd')) {
 					flags |= AXRT_DEFAULT;
 				}
+
+				/* Test for multicast member flag */
+				if (strchr(q, 'm')) {
+					flags |= AXRT_BCAST | AXRT_MCAST;
+				}
+
+				/* Test for source address learning flag */
+				if (strchr(q, 'l')) {
+					flags |= AXRT_LEARN;
+				}
 			}
 		}
-		route_add(tip, tcall, uport, flags);
+		route_add(&tip, tcall, uport, flags);
 		return 0;
 
 	} else if (strcmp(p, "broadcast") == 0) {
@@ -384,6 +463,43 @@ int parse_line(char *buf)
 		}
 		return 0;
 
+	} else if (strcmp(p, "multicast") == 0) {
+		q = strtok(NULL, " \t\n\r");
+		if (q == NULL)
+			return -1;
+		memset(&mcast_group, 0, sizeof(mcast_group));
+		if (inet_pton(AF_INET, q, &mcast_group.sin.sin_addr) == 1) {
+			mcast_group.sin.sin_family = AF_INET;
+			if (!IN_MULTICAST(ntohl(mcast_group.sin.sin_addr.s_addr))) {
+				mcast_group.sin.sin_family = AF_UNSPEC;
+				return -11;
+			}
+		} else if (inet_pton(AF_INET6, q,
+				     &mcast_group.sin6.sin6_addr) == 1) {
+			mcast_group.sin6.sin6_family = AF_INET6;
+			if (!IN6_IS_ADDR_MULTICAST(&mcast_group.sin6.sin6_addr)) {
+				mcast_group.sin6.sin6_family = AF_UNSPEC;
+				return -11;
+			}
+		} else
+			return -5;
+		while ((q = strtok(NULL, " \t\n\r")) != NULL) {
+			if (strcmp(q, "ttl") == 0) {
+				q = strtok(NULL, " \t\n\r");
+				if (q == NULL)
+					return -1;
+				mcast_ttl = atoi(q);
+			} else if (strcmp(q, "dev") == 0) {
+				q = strtok(NULL, " \t\n\r");
+				if (q == NULL)
+					return -1;
+				strncpy(mcast_dev, q, sizeof(mcast_dev)-1);
+				mcast_dev[sizeof(mcast_dev)-1] = 0;
+			} else
+				return -6;
+		}
+		return 0;
+
 	} else if (strcmp(p, "param") == 0) {
 		q = strtok(NULL, " \t\n\r");
 		if (q == NULL)
@@ -473,7 +589,11 @@ void dump_config(void)
 		LOGL1("  socket     ip\n");
 	if (udp_mode)
 		LOGL1("  socket     udp on port %d\n", ntohs(my_udp));
+	if (mcast_group.sa.sa_family != AF_UNSPEC)
+		LOGL1("  multicast  %s ttl %d%s%s\n", peer_to_a(&mcast_group),
+		      mcast_ttl, *mcast_dev ? " dev " : "", mcast_dev);
 	LOGL1("  mode       %s\n", digi ? "digi" : "tnc");
+	LOGL1("  framesize  %d\n", max_frame);
 	LOGL1("  device     %s\n", ttydevice);
 	LOGL1("  speed      %d\n", ttyspeed);
 	if (digi)
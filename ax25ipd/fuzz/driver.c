@@ -0,0 +1,149 @@
+/* driver.c      Replay inputs through a fuzz harness
+ *
+ *	fuzz_kiss [-r rounds] file|dir ...
+ *
+ * Runs every file (and every file in every directory) through the
+ * harness once, or rounds times and then reports the throughput; this
+ * is the parser benchmark over the seed corpus.  With no arguments the
+ * input is read from stdin, which is what AFL expects.  libFuzzer has
+ * its own main: build the harnesses with -DLIBFUZZER to leave this
+ * one out.
+ */
+
+#ifndef LIBFUZZER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "fuzz.h"
+
+struct input {
+	uint8_t *data;
+	size_t size;
+};
+
+static struct input *inputs;
+static int ninputs, ainputs;
+
+static void load_fp(FILE *fp, const char *name)
+{
+	uint8_t *data = NULL;
+	size_t size = 0, n;
+
+	do {
+		data = realloc(data, size + 4096);
+		if (data == NULL) {
+			perror(name);
+			exit(1);
+		}
+		n = fread(data + size, 1, 4096, fp);
+		size += n;
+	} while (n == 4096);
+
+	if (ninputs == ainputs) {
+		ainputs = ainputs ? 2 * ainputs : 64;
+		inputs = realloc(inputs, ainputs * sizeof(*inputs));
+		if (inputs == NULL) {
+			perror(name);
+			exit(1);
+		}
+	}
+	inputs[ninputs].data = data;
+	inputs[ninputs].size = size;
+	ninputs++;
+}
+
+static void load(const char *name)
+{
+	struct stat st;
+	struct dirent *d;
+	char path[4096];
+	DIR *dir;
+	FILE *fp;
+
+	if (stat(name, &st) < 0) {
+		perror(name);
+		exit(1);
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		dir = opendir(name);
+		if (dir == NULL) {
+			perror(name);
+			exit(1);
+		}
+		while ((d = readdir(dir)) != NULL) {
+			if (d->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", name, d->d_name);
+			load(path);
+		}
+		closedir(dir);
+		return;
+	}
+
+	fp = fopen(name, "r");
+	if (fp == NULL) {
+		perror(name);
+		exit(1);
+	}
+	load_fp(fp, name);
+	fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+	struct timespec t0, t1;
+	unsigned long bytes = 0;
+	long rounds = 0, r;
+	double secs;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "r:")) != -1) {
+		switch (c) {
+		case 'r':
+			rounds = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r rounds] file|dir ...\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc)
+		load_fp(stdin, "stdin");
+	for (i = optind; i < argc; i++)
+		load(argv[i]);
+
+	if (rounds <= 0) {
+		for (i = 0; i < ninputs; i++)
+			LLVMFuzzerTestOneInput(inputs[i].data, inputs[i].size);
+		return 0;
+	}
+
+	/* first round warms the caches and sets up the harness */
+	for (i = 0; i < ninputs; i++) {
+		LLVMFuzzerTestOneInput(inputs[i].data, inputs[i].size);
+		bytes += inputs[i].size;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < ninputs; i++)
+			LLVMFuzzerTestOneInput(inputs[i].data, inputs[i].size);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%d inputs, %lu bytes, %ld rounds: %.3f s, "
+	       "%.0f inputs/s, %.1f MB/s\n", ninputs, bytes, rounds, secs,
+	       ninputs * rounds / secs, bytes * rounds / secs / 1e6);
+	return 0;
+}
+
+#endif
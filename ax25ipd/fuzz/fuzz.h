@@ -0,0 +1,14 @@
+/* fuzz.h        Shared by the fuzz harnesses and the replay driver */
+
+#ifndef AX25IPD_FUZZ_H
+#define AX25IPD_FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* libFuzzer and AFL entry point, one per harness */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+void fuzz_setup(void);
+
+#endif
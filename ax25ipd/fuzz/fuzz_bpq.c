@@ -0,0 +1,32 @@
+/* fuzz_bpq.c    BPQ ethernet frames from the ethertap (receive_bpq)
+ *
+ * The input is one packet as read from the ethertap device, starting
+ * with its 16 byte header.  It is copied to a buffer with just the two
+ * bytes from_kiss() appends the CRC into.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../ax25ipd.h"
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	unsigned char *buf;
+
+	fuzz_setup();
+	ttyfd_bpq = 1;
+
+	/* io.c reads at most max_frame + IO_HDR_ROOM bytes */
+	if (size == 0 || size > (size_t) max_frame + 64)
+		return 0;
+	buf = malloc(size + 2);
+	if (buf == NULL)
+		return 0;
+	memcpy(buf, data, size);
+
+	receive_bpq(buf, size);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,38 @@
+/* fuzz_from_ip.c  AX.25 over IP/UDP frames (next_addr, from_ip)
+ *
+ * The input is one datagram payload, AX.25 frame plus CRC, from the
+ * IPv4 peer's address.  It is copied to a buffer of exactly its size
+ * so that a read past the frame is caught.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "../ax25ipd.h"
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	union peer_addr from;
+	unsigned char *buf;
+
+	fuzz_setup();
+
+	/* io.c drops these before from_ip() */
+	if (size == 0 || size > (size_t) max_frame)
+		return 0;
+	buf = malloc(size);
+	if (buf == NULL)
+		return 0;
+	memcpy(buf, data, size);
+
+	memset(&from, 0, sizeof(from));
+	from.sin.sin_family = AF_INET;
+	from.sin.sin_port = htons(10093);
+	inet_pton(AF_INET, "192.0.2.1", &from.sin.sin_addr);
+
+	from_ip(buf, size, &from);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,20 @@
+/* fuzz_kiss.c   The KISS byte stream (assemble_kiss, from_kiss)
+ *
+ * The input is a chunk of bytes read from the tty.  A frame left
+ * unfinished at the end is flushed with a FEND and the assembler
+ * state cleared, so that every input is run on its own.
+ */
+
+#include "../ax25ipd.h"
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static unsigned char fend = 0xc0;
+
+	fuzz_setup();
+
+	assemble_kiss((unsigned char *) data, size);
+	assemble_kiss(&fend, 1);
+	return 0;
+}
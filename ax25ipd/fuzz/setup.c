@@ -0,0 +1,63 @@
+/* setup.c       A configured ax25ipd for the fuzz harnesses
+ *
+ * Digi mode, two local calls, an IPv4 and an IPv6 peer that learn
+ * their address, a default route and two broadcast calls, so frames
+ * from the corpus get past the address checks and into routing.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "../ax25ipd.h"
+#include "../tests/stubs.h"
+#include "fuzz.h"
+
+void fuzz_setup(void)
+{
+	static int done;
+	union peer_addr pa;
+	unsigned char call[7];
+	unsigned char *p;
+
+	if (done)
+		return;
+	done = 1;
+
+	/* the same sizes io_open() gives them */
+	p = malloc(max_frame + 1 + 2 * max_frame + 4 + max_frame + 64);
+	if (p == NULL)
+		abort();
+	kiss_buffers(p, p + max_frame + 1);
+	bpq_buffer(p + max_frame + 1 + 2 * max_frame + 4);
+
+	kiss_init();
+	route_init();
+	process_init();
+
+	digi = 1;
+	stub_call(mycallsign, "N0CALL", 0x60 | (1 << 1));
+	stub_call(myalias, "RELAY", 0x60);
+
+	memset(&pa, 0, sizeof(pa));
+	pa.sin.sin_family = AF_INET;
+	inet_pton(AF_INET, "192.0.2.1", &pa.sin.sin_addr);
+	stub_call(call, "PEER", 0x60);
+	route_add(&pa, call, 10093, AXRT_BCAST | AXRT_LEARN);
+
+	stub_call(call, "GATE", 0x60);
+	route_add(&pa, call, 0, AXRT_DEFAULT);
+
+	memset(&pa, 0, sizeof(pa));
+	pa.sin6.sin6_family = AF_INET6;
+	inet_pton(AF_INET6, "2001:db8::1", &pa.sin6.sin6_addr);
+	stub_call(call, "PEER6", 0x60);
+	route_add(&pa, call, 10093, AXRT_BCAST | AXRT_LEARN);
+
+	stub_call(call, "QST", 0x60);
+	bcast_add(call);
+	stub_call(call, "NODES", 0x60);
+	bcast_add(call);
+
+	me_compile();
+}
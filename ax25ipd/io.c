@@ -10,11 +10,13 @@
  */
 #define _XOPEN_SOURCE
 #define _XOPEN_SOURCE_EXTENDED
+#define _DEFAULT_SOURCE
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <memory.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
@@ -38,10 +40,20 @@ static struct termio nterm;
 int ttyfd = -1;
 static int udpsock = -1;
 static int sock = -1;
+static int udpsock6 = -1;
+static int sock6 = -1;
 static struct sockaddr_in udpbind;
-static struct sockaddr_in to;
-static struct sockaddr_in from;
+static struct sockaddr_in6 udpbind6;
+static union peer_addr from;
 static socklen_t fromlen;
+static union peer_addr mcast_to;
+
+/* room for an IPv4 header or the bpqether header in front of a frame */
+#define IO_HDR_ROOM 64
+
+static unsigned char *frame_pool;
+static unsigned char *iobuf;
+static int iobuf_size;
 
 static time_t last_bc_time;
 
@@ -256,19 +268,161 @@ void io_init(void) {
     udpsock = -1;
   }
 
+  if (sock6 >= 0) {
+    close(sock6);
+    sock6 = -1;
+  }
+
+  if (udpsock6 >= 0) {
+    close(udpsock6);
+    udpsock6 = -1;
+  }
+
   /*
    * The memset is not strictly required - it simply zeros out the
-   * address structure.  Since both to and from are static, they are
-   * already clear.
+   * address structure.  Since from is static, it is already clear.
    */
-  memset(&to, 0, sizeof(struct sockaddr));
-  to.sin_family = AF_INET;
-
-  memset(&from, 0, sizeof(struct sockaddr));
-  from.sin_family = AF_INET;
+  memset(&from, 0, sizeof(from));
 
-  memset(&udpbind, 0, sizeof(struct sockaddr));
+  memset(&udpbind, 0, sizeof(udpbind));
   udpbind.sin_family = AF_INET;
+
+  memset(&udpbind6, 0, sizeof(udpbind6));
+  udpbind6.sin6_family = AF_INET6;
+
+  memset(&mcast_to, 0, sizeof(mcast_to));
+}
+
+/*
+ * Helpers for peer addresses
+ */
+
+socklen_t peer_len(union peer_addr *pa) {
+  return pa->sa.sa_family == AF_INET6 ? sizeof(pa->sin6) : sizeof(pa->sin);
+}
+
+int peer_port(union peer_addr *pa) {
+  return ntohs(pa->sa.sa_family == AF_INET6 ? pa->sin6.sin6_port
+                                            : pa->sin.sin_port);
+}
+
+char *peer_to_a(union peer_addr *pa) {
+  static char t[INET6_ADDRSTRLEN];
+
+  if (pa->sa.sa_family == AF_INET6)
+    inet_ntop(AF_INET6, &pa->sin6.sin6_addr, t, sizeof(t));
+  else
+    inet_ntop(AF_INET, &pa->sin.sin_addr, t, sizeof(t));
+  return t;
+}
+
+/*
+ * Open the IPv6 twin of a socket.  IPv6 is optional: if the host has no
+ * IPv6 we carry on with IPv4 alone.  The sockets are IPv6-only so that
+ * they can share the port with the IPv4 ones.
+ */
+
+static int open_socket6(int type, int protocol, char *what) {
+  int fd, on = 1;
+
+  fd = socket(AF_INET6, type, protocol);
+  if (fd < 0) {
+    LOGL1("no IPv6 %s socket: %s\n", what, strerror(errno));
+    return -1;
+  }
+  if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on)) < 0) {
+    LOGL1("IPV6_V6ONLY on %s socket: %s\n", what, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  if (fcntl(fd, F_SETFL, FNDELAY) < 0) {
+    perror("setting non-blocking I/O on IPv6 socket");
+    exit(1);
+  }
+  return fd;
+}
+
+/*
+ * Join the broadcast multicast group on the udp socket, and set it up
+ * so that what we send to the group goes out with the configured hop
+ * limit and does not come back to us.
+ */
+
+static void mcast_open6(int ifindex) {
+  struct ipv6_mreq mreq;
+  unsigned int loop = 0;
+  int hops = mcast_ttl;
+
+  if (udpsock6 < 0) {
+    fprintf(stderr, "IPv6 multicast group, but no IPv6 udp socket\n");
+    exit(1);
+  }
+  memset(&mreq, 0, sizeof(mreq));
+  mreq.ipv6mr_multiaddr = mcast_group.sin6.sin6_addr;
+  mreq.ipv6mr_interface = ifindex;
+  if (setsockopt(udpsock6, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq,
+                 sizeof(mreq)) < 0) {
+    perror("joining multicast group");
+    exit(1);
+  }
+  if (ifindex && setsockopt(udpsock6, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+                            &ifindex, sizeof(ifindex)) < 0) {
+    perror("setting multicast interface");
+    exit(1);
+  }
+  if (setsockopt(udpsock6, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops,
+                 sizeof(hops)) < 0)
+    perror("setting multicast hops");
+  if (setsockopt(udpsock6, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop,
+                 sizeof(loop)) < 0)
+    perror("disabling multicast loopback");
+
+  mcast_to = mcast_group;
+  mcast_to.sin6.sin6_port = my_udp;
+  mcast_to.sin6.sin6_scope_id = ifindex;
+}
+
+static void mcast_open(void) {
+  struct ip_mreqn mreq;
+  unsigned char loop = 0;
+  unsigned char ttl = mcast_ttl;
+  int ifindex = 0;
+
+  if (*mcast_dev) {
+    ifindex = if_nametoindex(mcast_dev);
+    if (ifindex == 0) {
+      perror("multicast interface");
+      exit(1);
+    }
+  }
+
+  if (mcast_group.sa.sa_family == AF_INET6) {
+    mcast_open6(ifindex);
+    return;
+  }
+
+  memset(&mreq, 0, sizeof(mreq));
+  mreq.imr_multiaddr = mcast_group.sin.sin_addr;
+  mreq.imr_ifindex = ifindex;
+  if (setsockopt(udpsock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                 sizeof(mreq)) < 0) {
+    perror("joining multicast group");
+    exit(1);
+  }
+  if (ifindex && setsockopt(udpsock, IPPROTO_IP, IP_MULTICAST_IF, &mreq,
+                            sizeof(mreq)) < 0) {
+    perror("setting multicast interface");
+    exit(1);
+  }
+  if (setsockopt(udpsock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl,
+                 sizeof(ttl)) < 0)
+    perror("setting multicast ttl");
+  if (setsockopt(udpsock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+                 sizeof(loop)) < 0)
+    perror("disabling multicast loopback");
+
+  mcast_to = mcast_group;
+  mcast_to.sin.sin_port = my_udp;
 }
 
 /*
@@ -297,6 +451,32 @@ int create_safe_symlink(char *target_path, char *link_path) {
   return 0;
 }
 
+/*
+ * Allocate all frame buffers in one go, sized from the framesize
+ * setting.  Nothing on the packet path allocates after this.
+ */
+
+static void pool_open(void) {
+  int kiss_in = max_frame + 1;
+  int kiss_out = 2 * max_frame + 4;
+  int bpq = max_frame + IO_HDR_ROOM;
+  unsigned char *p;
+
+  iobuf_size = max_frame + IO_HDR_ROOM;
+  free(frame_pool);
+  frame_pool = malloc(iobuf_size + kiss_in + kiss_out + bpq);
+  if (frame_pool == NULL) {
+    perror("allocating frame buffers");
+    exit(1);
+  }
+  p = frame_pool;
+  iobuf = p;
+  p += iobuf_size;
+  kiss_buffers(p, p + kiss_in);
+  p += kiss_in + kiss_out;
+  bpq_buffer(p);
+}
+
 /*
  * open and initialize the IO interfaces
  */
@@ -307,6 +487,8 @@ void io_open(void) {
   char *namepts = NULL;           /* name of the unix98 pts slave, which
                                    * the client has to use */
 
+  pool_open();
+
   if (ip_mode) {
     sock = socket(AF_INET, SOCK_RAW, IPPROTO_AX25);
     if (sock < 0) {
@@ -317,6 +499,7 @@ void io_open(void) {
       perror("setting non-blocking I/O on raw socket");
       exit(1);
     }
+    sock6 = open_socket6(SOCK_RAW, IPPROTO_AX25, "raw");
   }
 
   if (udp_mode) {
@@ -335,12 +518,33 @@ void io_open(void) {
      */
     udpbind.sin_addr.s_addr = INADDR_ANY;
     udpbind.sin_port = my_udp;
+    udpsock6 = open_socket6(SOCK_DGRAM, 0, "udp");
+    if (mcast_group.sa.sa_family != AF_UNSPEC) {
+      /* other group members may live on this host, too */
+      int on = 1;
+      setsockopt(udpsock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (udpsock6 >= 0)
+        setsockopt(udpsock6, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
     if (bind(udpsock, (struct sockaddr *)&udpbind, sizeof udpbind) < 0) {
       perror("binding udp socket");
       exit(1);
     }
+    if (udpsock6 >= 0) {
+      udpbind6.sin6_addr = in6addr_any;
+      udpbind6.sin6_port = my_udp;
+      if (bind(udpsock6, (struct sockaddr *)&udpbind6, sizeof udpbind6) < 0) {
+        LOGL1("binding IPv6 udp socket: %s\n", strerror(errno));
+        close(udpsock6);
+        udpsock6 = -1;
+      }
+    }
+    if (mcast_group.sa.sa_family != AF_UNSPEC)
+      mcast_open();
   }
 
+  route_check_v6(!udp_mode || udpsock6 >= 0, !ip_mode || sock6 >= 0);
+
   if (!strcmp("/dev/ptmx", ttydevice))
     i_am_unix98_pty_master = 1;
 
@@ -542,14 +746,37 @@ behind_normal_tty:
  *  run in a loop, using the select call to handle input.
  */
 
+/* Read one datagram from a udp socket */
+
+static void receive_udp(int fd, unsigned char *buf) {
+  int n;
+
+  do {
+    fromlen = sizeof from;
+    n = recvfrom(fd, buf, iobuf_size, MSG_TRUNC, &from.sa, &fromlen);
+  } while (io_error(n, buf, n, READ_MSG, UDP_MODE, __LINE__));
+  LOGL4("udpdata from=%s port=%d l=%d\n", peer_to_a(&from), peer_port(&from),
+        n);
+  stats.udp_in++;
+  if (n > max_frame) {
+    stats.udp_toobig++;
+    LOGL2("udp: dumped - frame too large\n");
+    return;
+  }
+  if (n > 0)
+    from_ip(buf, n, &from);
+}
+
 void io_start(void) {
   int n, nb, hdr_len;
   fd_set readfds;
-  unsigned char buf[MAX_FRAME];
+  unsigned char *buf;
   struct timeval wait;
   struct iphdr *ipptr;
   time_t now;
 
+  buf = iobuf;
+
   for (;;) {
 
     if ((bc_interval > 0) && digi) {
@@ -570,10 +797,14 @@ void io_start(void) {
 
     if (ip_mode) {
       FD_SET(sock, &readfds);
+      if (sock6 >= 0)
+        FD_SET(sock6, &readfds);
     }
 
     if (udp_mode) {
       FD_SET(udpsock, &readfds);
+      if (udpsock6 >= 0)
+        FD_SET(udpsock6, &readfds);
     }
 
     nb = select(FD_SETSIZE, &readfds, (fd_set *)0, (fd_set *)0, &wait);
@@ -594,7 +825,7 @@ void io_start(void) {
 
     if (FD_ISSET(ttyfd, &readfds)) {
       do {
-        n = read(ttyfd, buf, MAX_FRAME);
+        n = read(ttyfd, buf, iobuf_size);
       } while (io_error(n, buf, n, READ_MSG, TTY_MODE, __LINE__));
       LOGL4("ttydata l=%d\n", n);
       if (n > 0) {
@@ -618,34 +849,41 @@ void io_start(void) {
   out_ttyfd:
 
     if (udp_mode) {
-      if (FD_ISSET(udpsock, &readfds)) {
-        do {
-          fromlen = sizeof from;
-          n = recvfrom(udpsock, buf, MAX_FRAME, 0, (struct sockaddr *)&from,
-                       &fromlen);
-        } while (io_error(n, buf, n, READ_MSG, UDP_MODE, __LINE__));
-        LOGL4("udpdata from=%s port=%d l=%d\n", inet_ntoa(from.sin_addr),
-              ntohs(from.sin_port), n);
-        stats.udp_in++;
-        if (n > 0)
-          from_ip(buf, n);
-      }
+      if (FD_ISSET(udpsock, &readfds))
+        receive_udp(udpsock, buf);
+      if (udpsock6 >= 0 && FD_ISSET(udpsock6, &readfds))
+        receive_udp(udpsock6, buf);
     }
     /* if udp_mode */
     if (ip_mode) {
       if (FD_ISSET(sock, &readfds)) {
         do {
           fromlen = sizeof from;
-          n = recvfrom(sock, buf, MAX_FRAME, 0, (struct sockaddr *)&from,
-                       &fromlen);
+          n = recvfrom(sock, buf, iobuf_size, MSG_TRUNC, &from.sa, &fromlen);
         } while (io_error(n, buf, n, READ_MSG, IP_MODE, __LINE__));
         ipptr = (struct iphdr *)buf;
         hdr_len = 4 * ipptr->ihl;
-        LOGL4("ipdata from=%s l=%d, hl=%d\n", inet_ntoa(from.sin_addr), n,
-              hdr_len);
+        LOGL4("ipdata from=%s l=%d, hl=%d\n", peer_to_a(&from), n, hdr_len);
         stats.ip_in++;
-        if (n > hdr_len)
-          from_ip(buf + hdr_len, n - hdr_len);
+        if (n - hdr_len > max_frame) {
+          stats.ip_toobig++;
+          LOGL2("ip: dumped - frame too large\n");
+        } else if (n > hdr_len)
+          from_ip(buf + hdr_len, n - hdr_len, &from);
+      }
+      /* raw IPv6 sockets do not hand us the IP header */
+      if (sock6 >= 0 && FD_ISSET(sock6, &readfds)) {
+        do {
+          fromlen = sizeof from;
+          n = recvfrom(sock6, buf, iobuf_size, MSG_TRUNC, &from.sa, &fromlen);
+        } while (io_error(n, buf, n, READ_MSG, IP_MODE, __LINE__));
+        LOGL4("ip6data from=%s l=%d\n", peer_to_a(&from), n);
+        stats.ip_in++;
+        if (n > max_frame) {
+          stats.ip_toobig++;
+          LOGL2("ip: dumped - frame too large\n");
+        } else if (n > 0)
+          from_ip(buf, n, &from);
       }
     }
     /* if ip_mode */
@@ -654,32 +892,63 @@ void io_start(void) {
 
 /* Send an IP frame */
 
-void send_ip(unsigned char *buf, int l, unsigned char *targetip) {
-  int n;
+void send_ip(unsigned char *buf, int l, union peer_addr *to) {
+  int n, fd, v6;
+  int port;
 
   if (l <= 0)
     return;
-  memcpy(&to.sin_addr, targetip, 4);
-  memcpy(&to.sin_port, &targetip[4], 2);
-  LOGL4("sendipdata to=%s %s %d l=%d\n", inet_ntoa(to.sin_addr),
-        to.sin_port ? "udp" : "ip", ntohs(to.sin_port), l);
-  if (to.sin_port) {
+  v6 = to->sa.sa_family == AF_INET6;
+  port = peer_port(to);
+  LOGL4("sendipdata to=%s %s %d l=%d\n", peer_to_a(to), port ? "udp" : "ip",
+        port, l);
+  fd = port ? (v6 ? udpsock6 : udpsock) : (v6 ? sock6 : sock);
+  if ((port ? udp_mode : ip_mode) && fd < 0) {
+    stats.ip6_nosock++;
+    LOGL2("send_ip: dumped - no IPv6 socket for %s\n", peer_to_a(to));
+    return;
+  }
+  if (port) {
     if (udp_mode) {
       stats.udp_out++;
       do {
-        n = sendto(udpsock, buf, l, 0, (struct sockaddr *)&to, sizeof to);
+        n = sendto(fd, buf, l, 0, &to->sa, peer_len(to));
       } while (io_error(n, buf, l, SEND_MSG, UDP_MODE, __LINE__));
     }
   } else {
     if (ip_mode) {
       stats.ip_out++;
       do {
-        n = sendto(sock, buf, l, 0, (struct sockaddr *)&to, sizeof to);
+        n = sendto(fd, buf, l, 0, &to->sa, peer_len(to));
       } while (io_error(n, buf, l, SEND_MSG, IP_MODE, __LINE__));
     }
   }
 }
 
+/*
+ * Send a broadcast frame to the multicast group.  Returns -1 if there is
+ * no group or the send failed, so the caller can fall back to unicast.
+ */
+
+int send_mcast(unsigned char *buf, int l) {
+  int n, fd;
+
+  if (l <= 0 || !udp_mode || mcast_to.sa.sa_family == AF_UNSPEC)
+    return -1;
+  fd = mcast_to.sa.sa_family == AF_INET6 ? udpsock6 : udpsock;
+  if (fd < 0)
+    return -1;
+  LOGL4("sendmcast to=%s port=%d l=%d\n", peer_to_a(&mcast_to),
+        peer_port(&mcast_to), l);
+  do {
+    n = sendto(fd, buf, l, 0, &mcast_to.sa, peer_len(&mcast_to));
+  } while (io_error(n, buf, l, SEND_MSG, UDP_MODE, __LINE__));
+  if (n != l)
+    return -1;
+  stats.mcast_out++;
+  return 0;
+}
+
 /* Send a kiss frame */
 
 void send_tty(unsigned char *buf, int l) {
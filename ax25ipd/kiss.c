@@ -21,12 +21,12 @@
 #define TFEND 0xdc
 #define TFESC 0xdd
 
-static unsigned char iframe[MAX_FRAME];
+static unsigned char *iframe;	/* max_frame + 1 bytes */
 static unsigned char *ifptr;
 static int ifcount;
 static int iescaped;
 
-static unsigned char oframe[MAX_FRAME];
+static unsigned char *oframe;	/* 2 * max_frame + 4 bytes */
 static unsigned char *ofptr;
 static int ofcount;
 
@@ -54,6 +54,19 @@ void kiss_init(void)
 	param_tbl_top = 0;
 }
 
+/*
+ * Hand the KISS module its frame buffers (see io_open)
+ */
+
+void kiss_buffers(unsigned char *in, unsigned char *out)
+{
+	iframe = in;
+	oframe = out;
+	ifptr = iframe;
+	ifcount = 0;
+	iescaped = 0;
+}
+
 /*
  * Assemble a kiss frame from random hunks of incoming data
  * Calls the "from_kiss" routine with the kiss frame when a
@@ -71,8 +84,8 @@ void assemble_kiss(unsigned char *buf, int l)
 			if (ifcount > 0) {
 				/* Make sure that the control byte is zero */
 				if (*iframe == '\0' || *iframe == 0x10) {
-					/* Room for CRC in buffer? */
-					if (ifcount < (MAX_FRAME - 2)) {
+					/* Frame plus CRC fits? */
+					if (ifcount + 1 <= max_frame) {
 						stats.kiss_in++;
 						from_kiss(iframe +
 							  1, ifcount - 1);
@@ -103,7 +116,7 @@ void assemble_kiss(unsigned char *buf, int l)
 				c = FESC;
 			iescaped = 0;
 		}
-		if (ifcount < MAX_FRAME) {
+		if (ifcount <= max_frame) {
 			*ifptr = c;
 			ifptr++;
 			ifcount++;
@@ -114,7 +127,7 @@ void assemble_kiss(unsigned char *buf, int l)
 /* convert a standard AX25 frame into a kiss frame */
 void send_kiss(unsigned char type, unsigned char *buf, int l)
 {
-#define KISSEMIT(x) if (ofcount<MAX_FRAME) {*ofptr=(x);ofptr++;ofcount++;}
+#define KISSEMIT(x) if (ofcount<2*max_frame+4) {*ofptr=(x);ofptr++;ofcount++;}
 
 	int i;
 
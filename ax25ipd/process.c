@@ -13,6 +13,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <syslog.h>
 
@@ -20,22 +21,46 @@
 
 /* if dual port the upper nibble will have a value of 1 (not 0) */
 #define FROM_PORT2(p)   (((*(p+1))&0x10)!=0)
-#define FOR_PORT2(p)    (addrmatch(p,mycallsign2) || addrmatch(p,myalias2))
+#define FOR_PORT2(p)    ((me_match(p)&ME_PORT(1))!=0)
 /* ve3djf and ve3pnx addition above                             */
 #define IS_LAST(p)      (((*(p+6))&0x01)!=0)
 #define NOT_LAST(p)     (((*(p+6))&0x01)==0)
 #define REPEATED(p)     (((*(p+6))&0x80)!=0)
 #define NOTREPEATED(p)  (((*(p+6))&0x80)==0)
-#define IS_ME(p)        (addrmatch(p,mycallsign) || addrmatch(p,myalias) || addrmatch(p,mycallsign2) || addrmatch(p,myalias2) )
-#define NOT_ME(p)       (!(addrmatch(p,mycallsign) || addrmatch(p,myalias) || addrmatch(p,mycallsign2) || addrmatch(p,myalias2) ) )
+#define IS_ME(p)        (me_match(p)!=0)
+#define NOT_ME(p)       (me_match(p)==0)
 #define ARE_DIGIS(f)    (((*(f+13))&0x01)==0)
 #define NO_DIGIS(f)     (((*(f+13))&0x01)!=0)
 #define SETREPEATED(p)  (*(p+6))|=0x80
 #define SETLAST(p)      (*(p+6))|=0x01
 
+#define MAX_DIGIS 8		/* AX.25 allows no more than 8 digipeaters */
+
 static unsigned char bcbuf[256];	/* Must be larger than bc_text!!! */
 static int bclen;			/* The size of bcbuf */
 
+/*
+ * The local identities (mycall, myalias, mycall2, myalias2 and any
+ * extra aliases) compiled into masked 64 bit compares.  Each entry
+ * holds the callsign with the don't-care bits cleared and the mask
+ * to apply to a frame address before comparing; an SSID of 0 leaves
+ * the SSID bits out of the mask, just like addrmatch() does.
+ */
+#define ME_MAX		32
+
+static struct me_entry {
+	uint64_t val;
+	uint64_t mask;
+	unsigned int ports;	/* ME_PORT() bits of the KISS port(s) */
+} me_tbl[ME_MAX];
+static int me_cnt;
+
+static struct {
+	unsigned char call[7];
+	int port;
+} me_alias[ME_MAX];
+static int me_alias_cnt;
+
 /*
  * Initialize the process variables
  */
@@ -43,6 +68,101 @@ static int bclen;			/* The size of bcbuf */
 void process_init(void)
 {
 	bclen = -1;		/* flag that we need to rebuild the bctext */
+	me_cnt = 0;
+	me_alias_cnt = 0;
+}
+
+/*
+ * Register an additional alias for a KISS port.  Returns -1 if the
+ * table is full.
+ */
+int me_alias_add(unsigned char *call, int port)
+{
+	if (me_alias_cnt >= ME_MAX)
+		return -1;
+	memcpy(me_alias[me_alias_cnt].call, call, 7);
+	me_alias[me_alias_cnt].port = port;
+	me_alias_cnt++;
+	return 0;
+}
+
+static inline uint64_t addr_load(unsigned char *a)
+{
+	uint64_t v = 0;
+
+	memcpy(&v, a, 7);
+	return v;
+}
+
+static void me_add(unsigned char *call, int port)
+{
+	unsigned char m[7];
+	uint64_t mask;
+	int i;
+
+	/* addrmatch() never matches an empty callsign */
+	if (*call == '\0' || port < 0 || port > 15)
+		return;
+
+	for (i = 0; i < 6; i++)
+		m[i] = 0xfe;
+	m[6] = (call[6] & 0x1e) ? 0x1e : 0;	/* ssid 0 matches all ssid's */
+	mask = addr_load(m);
+
+	for (i = 0; i < me_cnt; i++) {
+		if (me_tbl[i].mask == mask &&
+		    me_tbl[i].val == (addr_load(call) & mask)) {
+			me_tbl[i].ports |= ME_PORT(port);
+			return;
+		}
+	}
+	if (me_cnt >= ME_MAX) {
+		LOGL1("too many local callsigns, %s ignored\n",
+		      call_to_a(call));
+		return;
+	}
+	me_tbl[me_cnt].mask = mask;
+	me_tbl[me_cnt].val = addr_load(call) & mask;
+	me_tbl[me_cnt].ports = ME_PORT(port);
+	me_cnt++;
+}
+
+/*
+ * Build the matcher from the configuration.  Called once the config
+ * file has been read.
+ */
+void me_compile(void)
+{
+	int i;
+
+	me_cnt = 0;
+	me_add(mycallsign, 0);
+	me_add(myalias, 0);
+	me_add(mycallsign2, 1);
+	me_add(myalias2, 1);
+	for (i = 0; i < me_alias_cnt; i++)
+		me_add(me_alias[i].call, me_alias[i].port);
+}
+
+/*
+ * Return the ME_PORT() bits of every KISS port the address belongs to,
+ * or 0 if it is not one of ours.  Gives the same answer as calling
+ * addrmatch() against each local callsign in turn.
+ */
+unsigned int me_match(unsigned char *a)
+{
+	uint64_t v;
+	unsigned int ports = 0;
+	int i;
+
+	if (*a == '\0')
+		return 0;
+
+	v = addr_load(a);
+	for (i = 0; i < me_cnt; i++)
+		if ((v & me_tbl[i].mask) == me_tbl[i].val)
+			ports |= me_tbl[i].ports;
+	return ports;
 }
 
 /*
@@ -70,7 +190,8 @@ void process_init(void)
 
 void from_kiss(unsigned char *buf, int l)
 {
-	unsigned char *a, *ipaddr;
+	unsigned char *a;
+	union peer_addr *ipaddr;
 
 	if (l < 15) {
 		LOGL2("from_kiss: dumped - length wrong!\n");
@@ -78,11 +199,17 @@ void from_kiss(unsigned char *buf, int l)
 		return;
 	}
 
+	a = next_addr(buf, l);
+	if (a == NULL) {
+		LOGL2("from_kiss: dumped - bad address field!\n");
+		stats.kiss_badaddr++;
+		return;
+	}
+
 	if (loglevel > 2)
 		dump_ax25frame("from_kiss: ", buf, l);
 
 	if (digi) {		/* if we are in digi mode */
-		a = next_addr(buf);
 		if (NOT_ME(a)) {
 			stats.kiss_not_for_me++;
 			LOGL4("from_kiss: (digi) dumped - not for me\n");
@@ -95,9 +222,8 @@ void from_kiss(unsigned char *buf, int l)
 			return;
 		}
 		SETREPEATED(a);
-		a = next_addr(buf);	/* find who gets it after us */
+		a = next_addr(buf, l);	/* find who gets it after us */
 	} else {		/* must be tnc mode */
-		a = next_addr(buf);
 #ifdef TNC_FILTER
 		if (IS_ME(a)) {
 			LOGL2
@@ -149,11 +275,18 @@ void from_kiss(unsigned char *buf, int l)
  * We simply send the packet to the KISS send routine.
  */
 
-void from_ip(unsigned char *buf, int l)
+void from_ip(unsigned char *buf, int l, union peer_addr *from)
 {
 	int port = 0;
+	unsigned int me;
 	unsigned char *a;
 
+	if (l < 15 + 2) {
+		stats.ip_tooshort++;
+		LOGL2("from_ip: dumped - length wrong!\n");
+		return;
+	}
+
 	if (!ok_crc(buf, l)) {
 		stats.ip_failed_crc++;
 		LOGL2("from_ip: dumped - CRC incorrect!\n");
@@ -161,9 +294,10 @@ void from_ip(unsigned char *buf, int l)
 	}
 	l = l - 2;		/* dump the blasted CRC */
 
-	if (l < 15) {
-		stats.ip_tooshort++;
-		LOGL2("from_ip: dumped - length wrong!\n");
+	a = next_addr(buf, l);
+	if (a == NULL) {
+		stats.ip_badaddr++;
+		LOGL2("from_ip: dumped - bad address field!\n");
 		return;
 	}
 
@@ -171,8 +305,8 @@ void from_ip(unsigned char *buf, int l)
 		dump_ax25frame("from_ip: ", buf, l);
 
 	if (digi) {		/* if we are in digi mode */
-		a = next_addr(buf);
-		if (NOT_ME(a)) {
+		me = me_match(a);
+		if (me == 0) {
 			stats.ip_not_for_me++;
 			LOGL2("from_ip: (digi) dumped - not for me!\n");
 			return;
@@ -183,12 +317,13 @@ void from_ip(unsigned char *buf, int l)
 			    ("from_ip: (digi) dumped - I am destination!\n");
 			return;
 		}
-		if (dual_port == 1 && FOR_PORT2(a)) {
-			port = 0x10;
+		/* the upper port wins if the address is on more than one */
+		if (dual_port == 1 && (me & ~ME_PORT(0))) {
+			while (me >>= 1)
+				port += 0x10;
 		}
 		SETREPEATED(a);
 	} else {		/* must be tnc mode */
-		a = next_addr(buf);
 #ifdef TNC_FILTER
 		if (NOT_ME(a)) {
 			LOGL2
@@ -197,6 +332,11 @@ void from_ip(unsigned char *buf, int l)
 		}
 #endif
 	}			/* end of tnc mode */
+
+	/* only frames we accept may move a route */
+	if (from != NULL)
+		route_learn(buf + 7, from);
+
 	if (!ttyfd_bpq)
 		send_kiss(port, buf, l);
 	else {
@@ -282,25 +422,36 @@ int addrmatch(unsigned char *a, unsigned char *b)
 /*
  * return pointer to the next station to get this packet
  */
-unsigned char *next_addr(unsigned char *f)
+unsigned char *next_addr(unsigned char *f, int l)
 {
-	unsigned char *a;
+	unsigned char *a, *next = NULL;
+	int n;
+
+	if (l < 15)
+		return NULL;
 
 /* If no digis, return the destination address */
 	if (NO_DIGIS(f))
 		return f;
 
-/* check each digi field.  The first one that hasn't seen it is the one */
+/*
+ * check each digi field.  The first one that hasn't seen it is the one.
+ * The address field must end within the frame, leaving room for the
+ * control byte, or the frame is bogus.
+ */
 	a = f + 7;
+	n = 0;
 	do {
 		a += 7;
-		if (NOTREPEATED(a))
-			return a;
+		if (++n > MAX_DIGIS || a + 7 >= f + l)
+			return NULL;
+		if (next == NULL && NOTREPEATED(a))
+			next = a;
 	}
 	while (NOT_LAST(a));
 
 /* all the digis have seen it.  return the destination address */
-	return f;
+	return next ? next : f;
 }
 
 /*
@@ -317,7 +468,8 @@ void add_crc(unsigned char *buf, int l)
 }
 
 /*
- * Dump AX25 frame.
+ * Dump AX25 frame.  The address field must have been checked with
+ * next_addr().
  */
 void dump_ax25frame(char *t, unsigned char *buf, int l)
 {
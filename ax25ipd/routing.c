@@ -28,13 +28,7 @@
 struct route_table_entry {
 	unsigned char callsign[7];	/* the callsign and ssid */
 	unsigned char padcall;	/* always set to zero */
-	union {
-		unsigned char ip_addr[4];	/* the IP address */
-		struct in_addr ip_addr_in;
-	};
-	unsigned short udp_port;	/* the port number if udp */
-	unsigned char pad1;
-	unsigned char pad2;
+	union peer_addr addr;	/* address and udp port (0 for ip) */
 	unsigned int flags;	/* route flags */
 	struct route_table_entry *next;
 };
@@ -60,7 +54,7 @@ void route_init(void)
 }
 
 /* Add a new route entry */
-void route_add(unsigned char *ip, unsigned char *call, int udpport,
+void route_add(union peer_addr *ip, unsigned char *call, int udpport,
 	unsigned int flags)
 {
 	struct route_table_entry *rl, *rn;
@@ -88,10 +82,11 @@ void route_add(unsigned char *ip, unsigned char *call, int udpport,
 		rn->callsign[i] = call[i] & 0xfe;
 	rn->callsign[6] = (call[6] & 0x1e) | 0x60;
 	rn->padcall = 0;
-	memcpy(rn->ip_addr, ip, 4);
-	rn->udp_port = htons(udpport);
-	rn->pad1 = 0;
-	rn->pad2 = 0;
+	rn->addr = *ip;
+	if (rn->addr.sa.sa_family == AF_INET6)
+		rn->addr.sin6.sin6_port = htons(udpport);
+	else
+		rn->addr.sin.sin_port = htons(udpport);
 	rn->flags = flags;
 	rn->next = NULL;
 
@@ -107,8 +102,64 @@ void route_add(unsigned char *ip, unsigned char *call, int udpport,
 	/* Log this entry ... */
 	LOGL4("added route: %s %s %s %d %d\n",
 	      call_to_a(rn->callsign),
-	      inet_ntoa(rn->ip_addr_in),
-	      rn->udp_port ? "udp" : "ip", ntohs(rn->udp_port), flags);
+	      peer_to_a(&rn->addr),
+	      udpport ? "udp" : "ip", udpport, flags);
+}
+
+/*
+ * A frame from call arrived from address from.  Routes flagged for
+ * learning follow the peer to its new address, e.g. a dynamic IPv4
+ * address.  The transport and the address family of a route stay as
+ * configured.
+ */
+void route_learn(unsigned char *call, union peer_addr *from)
+{
+	struct route_table_entry *rp;
+	unsigned char mycall[7];
+	int i;
+
+	for (i = 0; i < 6; i++)
+		mycall[i] = call[i] & 0xfe;
+	mycall[6] = (call[6] & 0x1e) | 0x60;
+
+	for (rp = route_tbl; rp; rp = rp->next) {
+		if (!(rp->flags & AXRT_LEARN) ||
+		    !addrmatch(mycall, rp->callsign))
+			continue;
+		/* keep the transport: ip and udp routes do not swap */
+		if ((peer_port(&rp->addr) == 0) != (peer_port(from) == 0))
+			continue;
+		if (rp->addr.sa.sa_family != from->sa.sa_family)
+			continue;
+		if (peer_len(&rp->addr) == peer_len(from) &&
+		    !memcmp(&rp->addr, from, peer_len(from)))
+			continue;
+		rp->addr = *from;
+		LOGL2("route %s learned address %s\n",
+		      call_to_a(rp->callsign), peer_to_a(from));
+	}
+}
+
+/*
+ * Warn about IPv6 routes whose socket (udp or raw) could not be opened.
+ * Frames for them are dropped and counted in ip6_nosock.
+ */
+void route_check_v6(int udp6, int ip6)
+{
+	struct route_table_entry *rp;
+	int port;
+
+	for (rp = route_tbl; rp; rp = rp->next) {
+		if (rp->addr.sa.sa_family != AF_INET6)
+			continue;
+		port = peer_port(&rp->addr);
+		if (port ? udp6 : ip6)
+			continue;
+		LOGL1("route %s to %s: no IPv6 %s socket, "
+		      "frames for it are dropped\n",
+		      call_to_a(rp->callsign), peer_to_a(&rp->addr),
+		      port ? "udp" : "raw");
+	}
 }
 
 /* Add a new broadcast address entry */
@@ -147,12 +198,10 @@ void bcast_add(unsigned char *call)
 }
 
 /*
- * Return an IP address and port number given a callsign.
- * We return a pointer to the address; the port number can be found
- * immediately following the IP address. (UGLY coding; to be fixed later!)
+ * Return the peer address (with udp port, if any) given a callsign.
  */
 
-unsigned char *call_to_ip(unsigned char *call)
+union peer_addr *call_to_ip(unsigned char *call)
 {
 	struct route_table_entry *rp;
 	unsigned char mycall[7];
@@ -172,8 +221,8 @@ unsigned char *call_to_ip(unsigned char *call)
 	while (rp) {
 		if (addrmatch(mycall, rp->callsign)) {
 			LOGL4("found ip addr %s\n",
-			      inet_ntoa(rp->ip_addr_in));
-			return rp->ip_addr;
+			      peer_to_a(&rp->addr));
+			return &rp->addr;
 		}
 		rp = rp->next;
 	}
@@ -184,8 +233,8 @@ unsigned char *call_to_ip(unsigned char *call)
 	 */
 	if (default_route) {
 		LOGL4("failed, using default ip addr %s\n",
-		      inet_ntoa(default_route->ip_addr_in));
-		return default_route->ip_addr;
+		      peer_to_a(&default_route->addr));
+		return &default_route->addr;
 	}
 
 	LOGL4("failed.\n");
@@ -224,15 +273,24 @@ int is_call_bcast(unsigned char *call)
 	return FALSE;
 }
 
-/* Traverse the routing table, transmitting the packet to each bcast route */
+/*
+ * Traverse the routing table, transmitting the packet to each bcast route.
+ * If a multicast group is configured one copy goes to the group, and only
+ * the bcast routes not flagged as group members still get a unicast copy.
+ * Should the group send fail, everybody gets unicast as before.
+ */
 void send_broadcast(unsigned char *buf, int l)
 {
 	struct route_table_entry *rp;
+	int mcast;
+
+	mcast = (send_mcast(buf, l) == 0);
 
 	rp = route_tbl;
 	while (rp) {
-		if (rp->flags & AXRT_BCAST) {
-			send_ip(buf, l, rp->ip_addr);
+		if ((rp->flags & AXRT_BCAST) &&
+		    !(mcast && (rp->flags & AXRT_MCAST))) {
+			send_ip(buf, l, &rp->addr);
 		}
 		rp = rp->next;
 	}
@@ -253,9 +311,9 @@ void dump_routes(void)
 	while (rp) {
 		LOGL1("  %s\t%s\t%s\t%d\t%d\n",
 		      call_to_a(rp->callsign),
-		      inet_ntoa(rp->ip_addr_in),
-		      rp->udp_port ? "udp" : "ip",
-		      ntohs(rp->udp_port), rp->flags);
+		      peer_to_a(&rp->addr),
+		      peer_port(&rp->addr) ? "udp" : "ip",
+		      peer_port(&rp->addr), rp->flags);
 		rp = rp->next;
 	}
 	fflush(stdout);
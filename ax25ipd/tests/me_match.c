@@ -0,0 +1,91 @@
+/* me_match.c    Check me_match() against addrmatch()
+ *
+ * me_match() must give exactly the ports addrmatch() would find by
+ * comparing a frame address with every local callsign in turn.  This
+ * goes through every SSID byte of a local callsign and every SSID byte
+ * of the frame address, with the first byte of the address normal,
+ * with its spare low bit set, empty and odd-but-empty.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../ax25ipd.h"
+#include "stubs.h"
+
+static unsigned char extra[7];
+
+static unsigned int reference(unsigned char *a)
+{
+	unsigned int ports = 0;
+
+	if (addrmatch(a, mycallsign))
+		ports |= ME_PORT(0);
+	if (addrmatch(a, myalias))
+		ports |= ME_PORT(0);
+	if (addrmatch(a, mycallsign2))
+		ports |= ME_PORT(1);
+	if (addrmatch(a, myalias2))
+		ports |= ME_PORT(1);
+	if (addrmatch(a, extra))
+		ports |= ME_PORT(1);
+	return ports;
+}
+
+static void configure(int local, int variant)
+{
+	process_init();
+
+	stub_call(mycallsign, "N0CALL", local);
+	memset(myalias, 0, sizeof(myalias));
+	memset(mycallsign2, 0, sizeof(mycallsign2));
+	memset(myalias2, 0, sizeof(myalias2));
+
+	if (variant) {
+		/* dual port, the same call with another SSID on port 2 */
+		stub_call(myalias, "ALIAS", 0x60);
+		stub_call(mycallsign2, "N0CALL", 0x60 | (7 << 1));
+	}
+
+	stub_call(extra, "ALIAS", local);
+	me_alias_add(extra, 1);
+	me_compile();
+}
+
+int main(void)
+{
+	static const char *calls[] = { "N0CALL", "ALIAS", "OTHER" };
+	static const int first[] = { -1, 0x01, 0x00, -2 };
+	unsigned char a[7];
+	unsigned long checked = 0, bad = 0;
+	int local, variant, c, f, ssid;
+
+	for (local = 0; local < 256; local++)
+		for (variant = 0; variant < 2; variant++) {
+			configure(local, variant);
+
+			for (c = 0; c < 3; c++)
+				for (f = 0; f < 4; f++)
+					for (ssid = 0; ssid < 256; ssid++) {
+						stub_call(a, calls[c], ssid);
+						if (first[f] == -2)
+							a[0] |= 0x01;
+						else if (first[f] >= 0)
+							a[0] = first[f];
+
+						checked++;
+						if (me_match(a) == reference(a))
+							continue;
+						if (bad++ < 10)
+							printf("local ssid %02x variant %d "
+							       "%s first %d ssid %02x: "
+							       "%x, addrmatch %x\n",
+							       local, variant, calls[c],
+							       first[f], ssid, me_match(a),
+							       reference(a));
+					}
+		}
+
+	printf("me_match: %lu addresses, %lu differ\n", checked, bad);
+	return bad != 0;
+}
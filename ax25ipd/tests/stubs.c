@@ -0,0 +1,84 @@
+/* stubs.c       What ax25ipd.c, io.c, config.c and syslog.c provide
+ *
+ * The checks and fuzz harnesses link the frame handling modules
+ * (process.c, routing.c, kiss.c, bpqether.c, crc.c) against these
+ * instead of the real daemon: no sockets, no tty, no config file.
+ * Frames handed to the output side are only counted.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "../ax25ipd.h"
+#include "stubs.h"
+
+unsigned char mycallsign[7];
+unsigned char mycallsign2[7];
+unsigned char myalias[7];
+unsigned char myalias2[7];
+char bc_text[128];
+int digi;
+int loglevel;
+int dual_port;
+int max_frame = MAX_FRAME;
+struct ax25ipd_stats stats;
+
+int ttyfd = -1;
+int ttyfd_bpq;
+int ttyspeed;
+
+unsigned long stub_sent;
+
+void LOGLn(int level, const char *format, ...)
+{
+}
+
+char *call_to_a(unsigned char *tcall)
+{
+	return "?";
+}
+
+socklen_t peer_len(union peer_addr *pa)
+{
+	return pa->sa.sa_family == AF_INET6 ? sizeof(pa->sin6) :
+	    sizeof(pa->sin);
+}
+
+int peer_port(union peer_addr *pa)
+{
+	return ntohs(pa->sa.sa_family == AF_INET6 ? pa->sin6.sin6_port :
+		     pa->sin.sin_port);
+}
+
+char *peer_to_a(union peer_addr *pa)
+{
+	return "?";
+}
+
+void send_ip(unsigned char *buf, int l, union peer_addr *to)
+{
+	stub_sent++;
+}
+
+int send_mcast(unsigned char *buf, int l)
+{
+	stub_sent++;
+	return 0;
+}
+
+void send_tty(unsigned char *buf, int l)
+{
+	stub_sent++;
+}
+
+/* store a callsign like "N0CALL" with the given SSID byte */
+
+void stub_call(unsigned char *call, const char *s, unsigned char ssid)
+{
+	int i;
+
+	for (i = 0; i < 6; i++)
+		call[i] = (*s ? *s++ : ' ') << 1;
+	call[6] = ssid;
+}
@@ -0,0 +1,10 @@
+/* stubs.h       Shared by the checks and fuzz harnesses */
+
+#ifndef AX25IPD_STUBS_H
+#define AX25IPD_STUBS_H
+
+extern unsigned long stub_sent;	/* frames handed to the output side */
+
+void stub_call(unsigned char *call, const char *s, unsigned char ssid);
+
+#endif
@@ -37,6 +37,8 @@ static const struct option lopts[] = {
 	{"del", 1, NULL, 'd'},
 	{"list", 1, NULL, 'l'},
 	{"expire", 1, NULL, 'e'},
+	{"ports", 0, NULL, 'p'},
+	{"stats", 0, NULL, 'S'},
 	{"save", 0, NULL, 's'},
 	{"reload", 0, NULL, 'r'},
 	{"shutdown", 0, NULL, 'q'},
@@ -47,7 +49,7 @@ static const struct option lopts[] = {
 	{NULL, 0, NULL, 0}
 };
 
-static const char *sopts = "a:d:l:e:srqvVh";
+static const char *sopts = "a:d:l:e:pSsrqvVh";
 
 static void usage(void)
 {
@@ -58,8 +60,11 @@ static void usage(void)
 		"          -a|--add ip <ip> <dev> <time> <call> <ipmode>\n");
 	fprintf(stderr, "          -d|--del ax25 <callsign> <dev>\n");
 	fprintf(stderr, "          -d|--del ip <ip>\n");
-	fprintf(stderr, "          -l|--list ax25|ip\n");
+	fprintf(stderr, "          -l|--list ax25|ip [port <port>] [call <prefix>] [age <minutes>]\n");
+	fprintf(stderr, "                            [mode v|d] [count <n>] [after <cursor>] [json]\n");
 	fprintf(stderr, "          -e|--expire <minutes>\n");
+	fprintf(stderr, "          -p|--ports\n");
+	fprintf(stderr, "          -S|--stats\n");
 	fprintf(stderr, "          -s|--save\n");
 	fprintf(stderr, "          -r|--reload\n");
 	fprintf(stderr, "          -q|--shutdown\n");
@@ -119,98 +124,111 @@ static char *get_next_arg(char **p)
 	return p2;
 }
 
-static void list_ax25(void)
-{
-	int sock, len, offs;
-	char buf[512], *b, *s, *digi, *call, *dev, *ct;
-	time_t t;
+/* "Tue Aug  6 16:35:38", formatted once per distinct time stamp */
 
-	sock = open_socket();
+static char *format_time(time_t t)
+{
+	static char buf[32];
+	static time_t last = -1;
 
-	wsock(sock, "list ax25\n");
+	if (t == 0)
+		return "(permanent)";
 
-	offs = 0;
+	if (t != last) {
+		strftime(buf, sizeof(buf), "%a %b %e %H:%M:%S",
+			 localtime(&t));
+		last = t;
+	}
 
-	printf("Callsign  Port   Last update         Path\n");
+	return buf;
+}
 
-/*
-		DB0PRA-15 scc3   Tue Aug  6 16:35:38 1996
-*/
+static void print_ax25(char *s)
+{
+	char *digi, *call, *dev;
+	time_t t;
 
-	while (1) {
-		len = read(sock, buf + offs, sizeof(buf) - offs - 1);
-		if (len <= 0) {
-			close(sock);
-			return;
-		}
+	call = get_next_arg(&s);
+	dev = get_next_arg(&s);
+	t = strtol(get_next_arg(&s), NULL, 16);
 
-		buf[len + offs] = '\0';
-		s = buf;
-		for (s = buf; (b = strchr(s, '\n')) != NULL; s = b + 1) {
-			*b = '\0';
+	printf("%-9s %-6s %s", call, dev, format_time(t));
 
-			if (s[0] == '.') {
-				close(sock);
-				return;
-			}
+	while ((digi = get_next_arg(&s)) != NULL)
+		printf(" %s", digi);
 
-			call = get_next_arg(&s);
-			dev = get_next_arg(&s);
-			t = strtol(get_next_arg(&s), NULL, 16);
+	printf("\n");
+}
 
-			if (t == 0) {
-				ct = "(permanent)";
-				ct = strdup(ct);
-			} else {
-				ct = strdup(ctime(&t));
-				ct[strlen(ct) - 6] = '\0';
-			}
+static void print_ip(char *s)
+{
+	char *ip, *call, *dev, *mode;
+	time_t t;
 
-			printf("%-9s %-6s %s", call, dev, ct);
+	ip = get_next_arg(&s);
+	dev = get_next_arg(&s);
+	t = strtol(get_next_arg(&s), NULL, 16);
+	call = get_next_arg(&s);
+	mode = get_next_arg(&s);
 
-			free(ct);
+	printf("%-15s %-6s %-9s %-4s %s\n", ip, dev, call, mode,
+	       format_time(t));
+}
 
-			while ((digi = get_next_arg(&s)) != NULL)
-				printf(" %s", digi);
+static void print_port(char *s)
+{
+	char *port, *dev, *n[6];
+	int k;
 
-			printf("\n");
-		}
+	port = get_next_arg(&s);
+	dev = get_next_arg(&s);
+	for (k = 0; k < 6; k++)
+		if ((n[k] = get_next_arg(&s)) == NULL)
+			n[k] = "?";
 
-		if (b == NULL && s != NULL) {
-			offs = strlen(s);
-			if (offs)
-				memcpy(buf, s, offs);
-		}
-	}
+	printf("%-9s %-6s %6s %6s %9s %6s %6s %9s\n", port, dev,
+	       n[0], n[1], n[2], n[3], n[4], n[5]);
+}
 
-	close(sock);
+static void print_line(char *s)
+{
+	puts(s);
 }
 
-static void list_ip(void)
+/*
+ * Send cmd with the filters given on the command line and hand each
+ * line of the reply to print(), or pass it through as it is for json
+ * output.
+ */
+
+static void list(char *cmd, char *header, int argc, char **argv,
+		 void (*print)(char *))
 {
-	int sock, len, offs;
-	char buf[512], *b, *s, *ip, *call, *dev, *ct, *mode;
-	time_t t;
+	int sock, len, offs, k, json = 0;
+	char buf[4096], *b, *s;
+
+	len = sprintf(buf, "%s", cmd);
+	for (k = 0; k < argc && len < 256; k++) {
+		len += sprintf(buf + len, " %.64s", argv[k]);
+		if (!strcmp(argv[k], "json"))
+			json = 1;
+	}
+	sprintf(buf + len, "\n");
 
 	sock = open_socket();
+	wsock(sock, buf);
 
-	wsock(sock, "list ip\n");
+	if (!json && header != NULL)
+		printf("%s\n", header);
 
 	offs = 0;
-	printf("IP Address      Port   Callsign  Mode Last update\n");
 
-/*
-		255.255.255.255 scc3   DB0PRA-15 v    Thu Jan  7 06:54:19 1971
- */
 	while (1) {
 		len = read(sock, buf + offs, sizeof(buf) - offs - 1);
-		if (len <= 0) {
-			close(sock);
-			return;
-		}
+		if (len <= 0)
+			break;
 
 		buf[len + offs] = '\0';
-		s = buf;
 		for (s = buf; (b = strchr(s, '\n')) != NULL; s = b + 1) {
 			*b = '\0';
 
@@ -219,33 +237,50 @@ static void list_ip(void)
 				return;
 			}
 
-			ip = get_next_arg(&s);
-			dev = get_next_arg(&s);
-			t = strtol(get_next_arg(&s), NULL, 16);
-			call = get_next_arg(&s);
-			mode = get_next_arg(&s);
-
-			if (t == 0) {
-				ct = "(permanent)";
-			} else {
-				ct = ctime(&t);
-				ct[strlen(ct) - 6] = '\0';
-			}
-
-			printf("%-15s %-6s %-9s %-4s %s\n", ip, dev, call,
-			       mode, ct);
+			if (json)
+				puts(s);
+			else if (!strncmp(s, "next ", 5))
+				printf("(more, continue with \"after %s\")\n",
+				       s + 5);
+			else
+				print(s);
 		}
 
-		if (b == NULL && s != NULL) {
-			offs = strlen(s);
-			if (offs)
-				memcpy(buf, s, offs);
-		}
+		offs = strlen(s);
+		if (offs)
+			memmove(buf, s, offs);
 	}
 
 	close(sock);
 }
 
+static void list_ax25(int argc, char **argv)
+{
+/*
+		DB0PRA-15 scc3   Tue Aug  6 16:35:38 1996
+*/
+	list("list ax25", "Callsign  Port   Last update         Path",
+	     argc, argv, print_ax25);
+}
+
+static void list_ip(int argc, char **argv)
+{
+/*
+		255.255.255.255 scc3   DB0PRA-15 v    Thu Jan  7 06:54:19 1971
+ */
+	list("list ip", "IP Address      Port   Callsign  Mode Last update",
+	     argc, argv, print_ip);
+}
+
+static void list_ports(void)
+{
+/*
+		9k6       scc3     1021   1024       311      7      -         0
+*/
+	list("ports", "Port      Dev      ax25  limit evictions     ip  limit evictions",
+	     0, NULL, print_port);
+}
+
 static void Version(void)
 {
 	int sock;
@@ -365,9 +400,9 @@ int main(int argc, char **argv)
 		return 0;
 	case 'l':
 		if (!strcmp(optarg, "ax25"))
-			list_ax25();
+			list_ax25(argc - optind, argv + optind);
 		else if (!strcmp(optarg, "ip"))
-			list_ip();
+			list_ip(argc - optind, argv + optind);
 		else
 			usage();
 		return 0;
@@ -380,6 +415,12 @@ int main(int argc, char **argv)
 		wsock(sock, buf);
 		close(sock);
 		return 0;
+	case 'p':
+		list_ports();
+		return 0;
+	case 'S':
+		list("stats", NULL, 0, NULL, print_line);
+		return 0;
 	case 's':
 		sock = open_socket();
 		wsock(sock, "save\n");
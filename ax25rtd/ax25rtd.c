@@ -34,9 +34,12 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
+#include <getopt.h>
 #include <syslog.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -58,9 +61,12 @@
 #include "../pathnames.h"
 #include "ax25rtd.h"
 
-config *Config = NULL;
+config_set *Configs = NULL;
 
 int reload = 0;
+static int terminate = 0;
+static int debug_dump = 0;
+time_t started;
 
 ip_rt_entry *ip_routes;
 int ip_routes_cnt;
@@ -73,166 +79,298 @@ int ax25_maxroutes = AX25_MAXROUTES;
 char ip_encaps_dev[32] = "";
 char iproute2_table[32] = "";
 
-config *dev_get_config(char *dev)
+/*
+ * Configs are looked up for every received frame, so index them by
+ * interface name, port name and ifindex.  The first config in the
+ * list wins, as with the old linear search.  Each config_set carries
+ * its own index, so a new one can be built and searched while the
+ * current one is still in use.
+ */
+
+static unsigned int name_hashfn(const char *name)
+{
+	unsigned int h = 0;
+
+	while (*name)
+		h = h * 31 + (unsigned char) *name++;
+
+	return (h ^ h >> 8) & (CFG_HASHSIZE - 1);
+}
+
+static unsigned int ifindex_hashfn(int ifindex)
+{
+	return (unsigned int) ifindex & (CFG_HASHSIZE - 1);
+}
+
+static config *dev_only_get_config(config_set *set, char *dev)
 {
 	config *config;
 
-	for (config = Config; config; config = config->next)
+	for (config = set->dev_hash[name_hashfn(dev)]; config;
+	     config = config->dev_next)
 		if (!strcmp(config->dev, dev))
 			return config;
-
-	return port_get_config(dev);
+	return NULL;
 }
 
-config *port_get_config(char *port)
+static config *set_port_get_config(config_set *set, char *port)
 {
 	config *config;
 
-	for (config = Config; config; config = config->next)
+	for (config = set->port_hash[name_hashfn(port)]; config;
+	     config = config->port_next)
 		if (!strcmp(config->port, port))
 			return config;
 	return NULL;
 }
 
+static config *set_ifindex_get_config(config_set *set, int ifindex)
+{
+	config *config;
+
+	for (config = set->ifindex_hash[ifindex_hashfn(ifindex)]; config;
+	     config = config->ifindex_next)
+		if (config->ifindex == ifindex)
+			return config;
+	return NULL;
+}
+
+void index_config(config_set *set)
+{
+	config *config, **head;
+
+	memset(set->dev_hash, 0, sizeof(set->dev_hash));
+	memset(set->port_hash, 0, sizeof(set->port_hash));
+	memset(set->ifindex_hash, 0, sizeof(set->ifindex_hash));
+
+	for (config = set->list; config; config = config->next) {
+		if (dev_only_get_config(set, config->dev) == NULL) {
+			head = &set->dev_hash[name_hashfn(config->dev)];
+			config->dev_next = *head;
+			*head = config;
+		}
+		if (set_port_get_config(set, config->port) == NULL) {
+			head = &set->port_hash[name_hashfn(config->port)];
+			config->port_next = *head;
+			*head = config;
+		}
+		if (set_ifindex_get_config(set, config->ifindex) == NULL) {
+			head = &set->ifindex_hash
+			    [ifindex_hashfn(config->ifindex)];
+			config->ifindex_next = *head;
+			*head = config;
+		}
+	}
+}
+
+config *set_dev_get_config(config_set *set, char *dev)
+{
+	config *config;
+
+	config = dev_only_get_config(set, dev);
+	if (config != NULL)
+		return config;
+
+	return set_port_get_config(set, dev);
+}
+
+config *dev_get_config(char *dev)
+{
+	return set_dev_get_config(Configs, dev);
+}
+
+config *ifindex_get_config(int ifindex)
+{
+	return set_ifindex_get_config(Configs, ifindex);
+}
+
+config *port_get_config(char *port)
+{
+	return set_port_get_config(Configs, port);
+}
+
 static void sig_reload(int d)
 {
 	reload = 1;
 	signal(SIGHUP, sig_reload);
 }
 
+/* the dump shares its buffer with control socket listings */
 static void sig_debug(int d)
 {
+	debug_dump = 1;
+	signal(SIGUSR1, sig_debug);
+}
+
+static void debug_dump_all(void)
+{
+	debug_dump = 0;
 	fprintf(stderr, "config:\n");
 	dump_config(2);
 	fprintf(stderr, "ip-routes:\n");
 	dump_ip_routes(2, 0);
 	fprintf(stderr, "ax25-routes:\n");
 	dump_ax25_routes(2, 0);
-	signal(SIGUSR1, sig_debug);
 }
 
 static void sig_term(int d)
 {
-	save_cache();
-	daemon_shutdown(0);
+	terminate = 1;
 }
 
 void daemon_shutdown(int reason)
 {
+	kern_flush();
+	if (nl_sock >= 0)
+		nl_flush();
 	unlink(DATA_AX25ROUTED_CTL_SOCK);
 	exit(reason);
 }
 
 #define FD_MAX(fd) {fd_max = (fd > fd_max? fd : fd_max); FD_SET(fd, &read_fds);}
 
+static const struct option lopts[] = {
+	{"replay", 1, NULL, 'R'},
+	{"port", 1, NULL, 'p'},
+	{NULL, 0, NULL, 0}
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: ax25rtd [-R|--replay <file.pcap> "
+		"[-p|--port <port>]]\n");
+	exit(1);
+}
+
 int main(int argc, char **argv)
 {
-	char buf[256];
-	int size, s, cntrl_s, cntrl_fd;
-	socklen_t cntrl_len;
-	struct sockaddr_un cntrl_addr;
+	int s;
 	fd_set read_fds, write_fds;
-	int fd_max;
+	struct timespec tv, *tvp;
+	sigset_t term, unblocked;
+	int fd_max, k, wait;
+	char *replay_file = NULL, *replay_port = NULL;
+
+	while ((k = getopt_long(argc, argv, "R:p:", lopts, NULL)) != -1) {
+		switch (k) {
+		case 'R':
+			replay_file = optarg;
+			break;
+		case 'p':
+			replay_port = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind < argc || (replay_port && !replay_file))
+		usage();
 
 	if (ax25_config_load_ports() == 0) {
 		fprintf(stderr, "ax25rtd: no AX.25 port configured\n");
 		return 1;
 	}
 
+	if (replay_file) {
+		replaying = 1;
+		load_config();
+		return replay(replay_file, replay_port);
+	}
+
 	load_config();
+
+	if (nl_open() < 0)
+		fprintf(stderr, "ax25rtd: no netlink, using ioctls\n");
+
 	load_cache();
+	journal_open();
 
 	if (fork())
 		return 0;
 
-	s = socket(PF_PACKET, SOCK_PACKET, htons(ETH_P_AX25));
+	started = time(NULL);
+
+	s = pkt_open();
 	if (s == -1) {
 		perror("AX.25 socket");
 		return 1;
 	}
 
-	cntrl_s = socket(AF_UNIX, SOCK_STREAM, 0);
-	if (cntrl_s < 0) {
+	if (ctl_open() < 0) {
 		perror("Control socket");
-		return 1;
-	}
-
-	unlink(DATA_AX25ROUTED_CTL_SOCK);
-
-	cntrl_addr.sun_family = AF_UNIX;
-	strcpy(cntrl_addr.sun_path, DATA_AX25ROUTED_CTL_SOCK);
-	cntrl_len =
-	    sizeof(cntrl_addr.sun_family) +
-	    strlen(DATA_AX25ROUTED_CTL_SOCK);
-
-	if (bind(cntrl_s, (struct sockaddr *) &cntrl_addr, cntrl_len) < 0) {
-		perror("bind Control socket");
 		daemon_shutdown(1);
 	}
 
-	chmod(DATA_AX25ROUTED_CTL_SOCK, 0600);
-	listen(cntrl_s, 1);
-
 	signal(SIGUSR1, sig_debug);
 	signal(SIGHUP, sig_reload);
 	signal(SIGTERM, sig_term);
+	/* a client that goes away mid-listing is an EPIPE, not our end */
+	signal(SIGPIPE, SIG_IGN);
 
-	cntrl_fd = -1;
+	/* SIGTERM and SIGUSR1 only get through while we wait in pselect() */
+	sigemptyset(&term);
+	sigaddset(&term, SIGTERM);
+	sigaddset(&term, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &term, &unblocked);
 
 	for (;;) {
+		/* SIGTERM: pselect() came back with EINTR */
+		if (terminate) {
+			save_cache();
+			daemon_shutdown(0);
+		}
+		if (debug_dump)
+			debug_dump_all();
+
 		fd_max = 0;
 		FD_ZERO(&read_fds);
 		FD_ZERO(&write_fds);
 		FD_MAX(s);
-		if (cntrl_fd > 0) {
-			FD_MAX(cntrl_fd);
-			FD_SET(cntrl_fd, &write_fds);
-		} else {
-			FD_MAX(cntrl_s);
+		if (nl_sock >= 0)
+			FD_MAX(nl_sock);
+		ctl_fds(&read_fds, &write_fds, &fd_max);
+
+		reclaim_config();
+
+		k = run_timers();
+		wait = journal_sync(0);
+		if (k < 0 || (wait >= 0 && wait < k))
+			k = wait;
+
+		/* kernel changes queued since the last round */
+		wait = kern_apply();
+		if (k < 0 || (wait >= 0 && wait < k))
+			k = wait;
+		if (nl_sock >= 0)
+			nl_flush();
+
+		tvp = NULL;
+		if (k >= 0) {
+			tv.tv_sec = k;
+			tv.tv_nsec = 0;
+			tvp = &tv;
 		}
 
-		if (select(fd_max + 1, &read_fds, NULL, &write_fds, NULL) < 0) {
+		if (pselect(fd_max + 1, &read_fds, &write_fds, NULL, tvp,
+			    &unblocked) < 0) {
 			if (errno == EINTR)	/* woops! */
 				continue;
 
-			if (!FD_ISSET(cntrl_fd, &write_fds)) {
-				perror("select");
-				save_cache();
-				daemon_shutdown(1);
-			} else {
-				close(cntrl_fd);
-				cntrl_fd = -1;
-				continue;
-			}
+			perror("select");
+			save_cache();
+			daemon_shutdown(1);
 		}
 
-		if (cntrl_fd > 0) {
-			if (FD_ISSET(cntrl_fd, &read_fds)) {
-				size = read(cntrl_fd, buf, sizeof(buf));
-				if (size > 0) {
-					buf[size] = '\0';
-					interpret_command(cntrl_fd, buf);
-				} else {
-					close(cntrl_fd);
-					cntrl_fd = -1;
-				}
-			}
-		} else if (FD_ISSET(cntrl_s, &read_fds)) {
-			cntrl_fd = accept(cntrl_s,
-					  (struct sockaddr *)&cntrl_addr,
-					  &cntrl_len);
-			if (cntrl_fd < 0) {
-				perror("accept Control");
-				save_cache();
-				daemon_shutdown(1);
-			}
-		}
+		ctl_process(&read_fds, &write_fds);
 
 		if (reload)
 			reload_config();
 
 		if (FD_ISSET(s, &read_fds))
-			ax25_receive(s);
+			pkt_receive(s);
+
+		if (nl_sock >= 0 && FD_ISSET(nl_sock, &read_fds))
+			nl_receive();
 	}
 
 	return 0;		/* what ?! */
@@ -23,12 +23,18 @@
 #define IP_MAXROUTES	4096
 #define AX25_MAXROUTES	4096
 #define AX25_MAXCALLS	32
+#define AX25_MAXPATHS	3	/* candidate paths per callsign */
+
+/* buckets in the hash tables, must be powers of two */
+#define RT_HASHSIZE	4096
+#define CFG_HASHSIZE	64
 
 /* Some AX.25 stuff */
 
 #define NEW_ARP		1
 #define NEW_ROUTE	2
 #define NEW_IPMODE	4
+#define NEW_ENTRY	8	/* not in the cache before */
 
 #define SEG_FIRST       0x80
 #define SEG_REM         0x7F
@@ -53,30 +59,78 @@
 
 /* structs for the caches */
 
+struct rt_part_;
+
+typedef struct rt_timer_ {
+	struct rt_timer_	*next, **pprev;	/* timer wheel slot */
+	time_t			expires;	/* 0 if not armed */
+} rt_timer;
+
 typedef struct ip_rt_entry_ {
-	struct ip_rt_entry_	*next, *prev;
+	struct ip_rt_entry_	*next, *prev;	/* LRU list */
+	struct ip_rt_entry_	*hnext;		/* hash chain */
+	struct ip_rt_entry_	*cnext, *cprev;	/* chain by callsign */
+	struct ip_rt_entry_	*pnext, *pprev;	/* LRU list of the port */
+	struct rt_part_		*part;
+	rt_timer		timer;
 	unsigned long		ip;
 	char			iface[14];
 	ax25_address		call;
 	char			ipmode;
 	time_t			timestamp;
+	time_t			journaled;	/* timestamp on disk */
 	char			invalid;
 } ip_rt_entry;
 
+/* a path a station was heard on */
+
+typedef struct ax25_path_ {
+	ax25_address		digipeater[AX25_MAX_DIGIS];
+	int			ndigi;
+	long			hits;
+	time_t			heard;
+} ax25_path;
+
 typedef struct ax25_rt_entry_ {
-	struct ax25_rt_entry_	*next, *prev;
+	struct ax25_rt_entry_	*next, *prev;	/* LRU list */
+	struct ax25_rt_entry_	*hnext;		/* hash chain */
+	struct ax25_rt_entry_	*pnext, *pprev;	/* LRU list of the port */
+	struct rt_part_		*part;
+	rt_timer		timer;
 	char			iface[14];
 	ax25_address		call;
-	ax25_address		digipeater[AX25_MAX_DIGIS];
+	ax25_address		digipeater[AX25_MAX_DIGIS];	/* in use */
 	int			ndigi;
-	long			cnt;
+	long			cnt;		/* frames heard */
 	time_t			timestamp;
+	time_t			journaled;	/* timestamp on disk */
+	int			npaths;		/* candidates */
+	ax25_path		path[AX25_MAXPATHS];
 } ax25_rt_entry;
 
+/*
+ * The entries learned on one device.  Partitions are made on first use
+ * and never freed, so they outlive the configs that point to them.
+ */
+
+typedef struct rt_part_ {
+	struct rt_part_		*next;
+	char			dev[14];
+	ax25_rt_entry		*ax25_head, *ax25_tail;
+	int			ax25_cnt;
+	unsigned long		ax25_evictions;
+	ip_rt_entry		*ip_head, *ip_tail;
+	int			ip_cnt;
+	unsigned long		ip_evictions;
+} rt_part;
+
 /* struct for the channel configuration */
 
 typedef struct config_ {
 	struct config_ *next;
+	struct config_ *dev_next;
+	struct config_ *port_next;
+	struct config_ *ifindex_next;
 	char port[128];
 	char dev[14];
 
@@ -93,8 +147,16 @@ typedef struct config_ {
 	unsigned int  vc_mtu;
 	unsigned long tcp_irtt;
 
+	time_t ax25_ttl;	/* seconds, 0 = never expire */
+	time_t ip_ttl;
+
+	int ax25_maxroutes;	/* entries on this port, 0 = no own limit */
+	int ip_maxroutes;
+	rt_part *part;		/* set on first use */
+
 	unsigned long netmask;
 	unsigned long ip;
+	int ifindex;
 
 	int nmycalls;
 	ax25_address mycalls[AX25_MAXCALLS];
@@ -102,11 +164,44 @@ typedef struct config_ {
 	struct full_sockaddr_ax25 ax25_default_path;
 } config;
 
+/*
+ * A whole configuration with its indices.  reload_config() builds a new
+ * one next to the current one and publishes it by switching Configs.
+ */
+
+typedef struct config_set_ {
+	config *list;
+	config *dev_hash[CFG_HASHSIZE];
+	config *port_hash[CFG_HASHSIZE];
+	config *ifindex_hash[CFG_HASHSIZE];
+
+	/* global options, copied out when the set is published */
+	char ip_encaps_dev[32];
+	char iproute2_table[32];
+	int ip_maxroutes;
+	int ax25_maxroutes;
+} config_set;
+
+/* what a "list" command asked for */
+
+typedef struct list_filter_ {
+	config *config;			/* port, NULL for all */
+	char call[10];			/* callsign prefix */
+	int age;			/* minutes, 0 for any age */
+	int ipmode;			/* -1 for any */
+	int count;			/* page size, 0 for everything */
+	int json;
+	int after;			/* continue after the key below */
+	ax25_address after_call;
+	unsigned long after_ip;
+} list_filter;
+
 /* global variables */
 
 extern int reload;
+extern time_t started;
 
-extern config *Config;
+extern config_set *Configs;
 
 extern ip_rt_entry * ip_routes;
 extern int ip_routes_cnt;
@@ -123,6 +218,7 @@ extern char iproute2_table[];
 
 void load_config(void);
 void reload_config(void);
+void reclaim_config(void);
 void load_cache(void);
 void save_cache(void);
 void interpret_command(int fd, char *buf);
@@ -130,33 +226,153 @@ void interpret_command(int fd, char *buf);
 /* listener.c */
 
 int call_is_mycall(config *config, ax25_address *call);
+int kern_arp(config *config, long ip, ax25_address *call);
+int kern_route(config *config, long ip);
+int kern_ip_del(config *config, long ip);
+int kern_ax25_route(config *config, ax25_address *call, int ndigi, ax25_address *digi);
+int kern_ax25_del(config *config, ax25_address *call);
+int kern_ipmode(config *config, ax25_address *call, int ipmode);
+
+/* frames not learned from, by reason */
+struct frame_stat {
+	unsigned long frames;		/* handed to ax25_frame() */
+	unsigned long no_config;	/* heard on a device we do not serve */
+	unsigned long bad_frame;	/* not KISS data, or cut short */
+	unsigned long bad_addr;
+	unsigned long not_digipeated;
+	unsigned long ring_drops;	/* lost in the kernel, ring full */
+};
+
+extern struct frame_stat frame_stats;
+
+void ax25_frame(config *config, unsigned char *buf, int size, time_t stamp);
+
+/* kern.c */
+
+#define KOP_AX25_ADD	0
+#define KOP_AX25_DEL	1
+#define KOP_IP_ADD	2
+#define KOP_IP_DEL	3
+#define KOP_ARP		4
+#define KOP_IPMODE	5
+#define KOP_MAX		6
+
+struct kern_stat {
+	unsigned long queued;	/* new intents */
+	unsigned long merged;	/* replaced a waiting one */
+	unsigned long applied;
+	unsigned long retried;
+	unsigned long failed;
+	unsigned long timed;	/* changes the latency is known of */
+	unsigned long long usec;	/* their total */
+	unsigned long usec_max;
+};
+
+extern struct kern_stat kern_stats[KOP_MAX];
+
 int set_arp(config *config, long ip, ax25_address *call);
-int set_route(config *config, long ip);
-int set_ax25_route(config *config, ax25_rt_entry *rt);
+int set_route(config *config, long ip, int fresh);
+int set_ax25_route(config *config, ax25_rt_entry *rt, int fresh);
 int set_ipmode(config *config, ax25_address *call, int ipmode);
 int del_kernel_ip_route(char *dev, long ip);
 int del_kernel_ax25_route(char *dev, ax25_address *call);
-void ax25_receive(int sock);
+int kern_apply(void);
+void kern_flush(void);
+void kern_latency(int op, struct timespec *since);
+
+/* packet.c */
+
+int pkt_open(void);
+void pkt_receive(int sock);
+void pkt_filter(void);
+void pkt_stats(void);
 
 /* ax25rtd.c */
 
 void daemon_shutdown(int reason);
-int set_ipmode(config *config, ax25_address *call, int ipmode);
+void index_config(config_set *set);
+config * set_dev_get_config(config_set *set, char *dev);
 config * dev_get_config(char *dev);
+config * ifindex_get_config(int ifindex);
 config * port_get_config(char *port);
 
+/* control.c */
+
+int ctl_open(void);
+void ctl_write(int fd, const char *buf, int len);
+void ctl_close(int fd);
+void ctl_fds(fd_set *read_fds, fd_set *write_fds, int *fd_max);
+void ctl_process(fd_set *read_fds, fd_set *write_fds);
+
+/* snapshot.c */
+
+#define J_AX25		1
+#define J_IP		2
+#define J_DEL_AX25	3
+#define J_DEL_IP	4
+#define J_INVALID_IP	5
+
+int save_snapshot(void);
+int load_snapshot(void);
+void journal_open(void);
+int journal_sync(int force);
+void journal_ax25(int op, ax25_rt_entry *bp);
+void journal_ip(int op, ip_rt_entry *bp);
+void journal_ax25_heard(ax25_rt_entry *bp);
+void journal_ip_heard(ip_rt_entry *bp);
+
+/* replay.c */
+
+extern int replaying;
+
+int replay(char *file, char *port);
+
 /* cache_dump.c */
 
 void dump_ip_routes(int fd, int cmd);
 void dump_ax25_routes(int fd, int cmd);
+void list_ip_routes(int fd, list_filter *filter);
+void list_ax25_routes(int fd, list_filter *filter);
+void list_ports(int fd);
+void list_stats(int fd);
 void dump_config(int fd);
 
+/* netlink.c */
+
+extern int nl_sock;
+extern unsigned long nl_queued;
+
+int nl_open(void);
+int nl_route(int add, unsigned long ip, config *config);
+int nl_neigh(unsigned long ip, config *config, ax25_address *call);
+void nl_flush(void);
+void nl_receive(void);
+void nl_dump_routes(void);
+int nl_host_routes(unsigned long ip, int *ifindex, int max);
+
 /* cache_ctl.c */
 
+struct cache_stat {
+	unsigned long hits;		/* heard again */
+	unsigned long misses;		/* new entries */
+	unsigned long evictions;	/* dropped to make room */
+	unsigned long expired;
+};
+
+extern struct cache_stat ax25_cache_stats, ip_cache_stats;
+extern rt_part *rt_parts;
+
+rt_part *config_part(config *config);
 int update_ip_route(config *config, unsigned long ip, int ipmode, ax25_address *call, time_t timestamp);
-ax25_rt_entry * update_ax25_route(config *config, ax25_address *call, int ndigi, ax25_address *digi, time_t timestamp);
+ax25_rt_entry * update_ax25_route(config *config, ax25_address *call, int ndigi, ax25_address *digi, time_t timestamp, int force);
 int del_ip_route(unsigned long ip);
 int invalidate_ip_route(unsigned long ip);
 int del_ax25_route(config * config, ax25_address *call);
+void forget_ip_route(unsigned long ip);
+void forget_ax25_route(ax25_address *call);
 void expire_ax25_route(time_t when);
 void expire_ip_route(time_t when);
+void rearm_timers(void);
+int run_timers(void);
+ax25_rt_entry *ax25_route_after(ax25_address *call);
+ip_rt_entry *ip_route_after(unsigned long *ip);
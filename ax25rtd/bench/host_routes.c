@@ -0,0 +1,226 @@
+/*
+ * host_routes.c	Time the host route mirror against /proc/net/route
+ *
+ *	host_routes [-n routes] [-l lookups]
+ *
+ * Builds a synthetic RTM_NEWROUTE dump (100000 routes by default, one
+ * in eight through a gateway and one in sixteen not a host route) and
+ * feeds it to netlink.c in recv() sized chunks, as nl_dump_routes()
+ * would.  Then times nl_host_routes() lookups, host_route_change()
+ * deletes and re-adds, and the /proc/net/route scan that kern_route()
+ * does without netlink, over a file with the same routes.
+ *
+ * netlink.c is included so its static functions can be called.
+ */
+
+#include <stddef.h>
+
+#include "../netlink.c"
+
+char iproute2_table[32];
+struct kern_stat kern_stats[KOP_MAX];
+
+void kern_latency(int op, struct timespec *since)
+{
+}
+
+int invalidate_ip_route(unsigned long ip)
+{
+	return 0;
+}
+
+struct route_msg {
+	struct nlmsghdr nlh;
+	struct rtmsg rtm;
+	struct rtattr dst_rta;
+	uint32_t dst;
+	struct rtattr oif_rta;
+	int oif;
+	struct rtattr gw_rta;
+	uint32_t gw;
+};
+
+static uint32_t route_ip(int k)
+{
+	return htonl(0x2c000000 + k * 7);	/* 44.0.0.0/8, spread out */
+}
+
+static void route_build(struct route_msg *m, int type, int k)
+{
+	int gw = k % 8 == 7;
+
+	memset(m, 0, sizeof(*m));
+	m->nlh.nlmsg_len = sizeof(*m);
+	if (!gw)
+		m->nlh.nlmsg_len = offsetof(struct route_msg, gw_rta);
+	m->nlh.nlmsg_type = type;
+	m->nlh.nlmsg_flags = NLM_F_MULTI;
+	m->rtm.rtm_family = AF_INET;
+	m->rtm.rtm_dst_len = k % 16 == 5 ? 24 : 32;
+	m->rtm.rtm_table = RT_TABLE_MAIN;
+	m->rtm.rtm_type = RTN_UNICAST;
+	m->dst_rta.rta_type = RTA_DST;
+	m->dst_rta.rta_len = RTA_LENGTH(4);
+	m->dst = route_ip(k);
+	m->oif_rta.rta_type = RTA_OIF;
+	m->oif_rta.rta_len = RTA_LENGTH(sizeof(int));
+	m->oif = 2 + k % 4;
+	m->gw_rta.rta_type = RTA_GATEWAY;
+	m->gw_rta.rta_len = RTA_LENGTH(4);
+	m->gw = htonl(0x2c000001);
+}
+
+static double since(struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/* kern_route() without netlink: clear_host_routes_proc() in listener.c */
+
+static int proc_scan(const char *file, long ip)
+{
+	char origdev[16], buf[1024];
+	long ipr, gwr;
+	int found = 0;
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (fp == NULL)
+		return -1;
+
+	fgets(buf, sizeof(buf) - 1, fp);	/* discard header */
+	while (fgets(buf, sizeof(buf) - 1, fp) != NULL) {
+		sscanf(buf, "%s %lx %lx", origdev, &ipr, &gwr);
+		if (ipr == ip && gwr == 0)
+			found++;
+	}
+	fclose(fp);
+	return found;
+}
+
+static int proc_write(const char *file, int nroutes)
+{
+	struct route_msg m;
+	FILE *fp;
+	int k;
+
+	fp = fopen(file, "w");
+	if (fp == NULL)
+		return -1;
+
+	fprintf(fp, "Iface\tDestination\tGateway \tFlags\tRefCnt\tUse\t"
+		"Metric\tMask\t\tMTU\tWindow\tIRTT\n");
+	for (k = 0; k < nroutes; k++) {
+		route_build(&m, RTM_NEWROUTE, k);
+		fprintf(fp, "ax%d\t%08X\t%08X\t%04X\t0\t0\t0\t%08X\t0\t0\t0\n",
+			m.oif - 2, m.dst,
+			m.nlh.nlmsg_len == sizeof(m) ? m.gw : 0,
+			m.nlh.nlmsg_len == sizeof(m) ? 0x7 : 0x5,
+			m.rtm.rtm_dst_len == 32 ? 0xffffffff : 0x00ffffff);
+	}
+	return fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+	struct route_msg m;
+	struct timespec t0;
+	unsigned char *dump, *p;
+	char file[] = "/tmp/host_routes.XXXXXX";
+	int nroutes = 100000, nlookups = 1000000, nscans = 20;
+	int ifindex[8], c, k, n, len, chunk, found = 0, fd;
+	struct nlmsghdr *nlh;
+	double secs;
+
+	while ((c = getopt(argc, argv, "n:l:")) != -1) {
+		switch (c) {
+		case 'n':
+			nroutes = atoi(optarg);
+			break;
+		case 'l':
+			nlookups = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: host_routes [-n routes] "
+				"[-l lookups]\n");
+			return 1;
+		}
+	}
+	if (nroutes <= 0 || nlookups <= 0)
+		return 1;
+
+	dump = malloc((size_t) nroutes * sizeof(m));
+	if (dump == NULL) {
+		perror("host_routes");
+		return 1;
+	}
+	for (p = dump, k = 0; k < nroutes; k++, p += len) {
+		route_build(&m, RTM_NEWROUTE, k);
+		len = NLMSG_ALIGN(m.nlh.nlmsg_len);
+		memcpy(p, &m, len);
+	}
+	len = p - dump;
+
+	/* the kernel fills each recv() with whole messages */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (p = dump; p < dump + len; p += chunk) {
+		for (chunk = 0; p + chunk < dump + len; chunk += n) {
+			nlh = (struct nlmsghdr *) (p + chunk);
+			n = NLMSG_ALIGN(nlh->nlmsg_len);
+			if (chunk + n > (int) sizeof(nl_rbuf))
+				break;
+		}
+		memcpy(nl_rbuf, p, chunk);
+		nl_parse(nl_rbuf, chunk);
+	}
+	secs = since(&t0);
+	for (k = 0; k < RT_HASHSIZE; k++) {
+		struct host_route *hr;
+
+		for (hr = host_routes[k]; hr; hr = hr->next)
+			found++;
+	}
+	printf("mirror build: %d routes, %d host routes, %.1f ms\n",
+	       nroutes, found, secs * 1e3);
+
+	found = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < nlookups; k++)
+		found += nl_host_routes(route_ip(k % (2 * nroutes)),
+					ifindex, 8);
+	secs = since(&t0);
+	printf("nl_host_routes: %d lookups (%d found), %.0f ns each\n",
+	       nlookups, found, secs * 1e9 / nlookups);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < nlookups; k++) {
+		route_build(&m, RTM_DELROUTE, k % nroutes);
+		host_route_change(&m.nlh);
+		m.nlh.nlmsg_type = RTM_NEWROUTE;
+		host_route_change(&m.nlh);
+	}
+	secs = since(&t0);
+	printf("host_route_change: %d deletes and adds, %.0f ns each\n",
+	       nlookups, secs * 1e9 / nlookups / 2);
+
+	fd = mkstemp(file);
+	if (fd < 0 || proc_write(file, nroutes) < 0) {
+		perror(file);
+		return 1;
+	}
+	close(fd);
+
+	found = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < nscans; k++)
+		found += proc_scan(file, route_ip(k * (nroutes / nscans)));
+	secs = since(&t0);
+	unlink(file);
+	printf("/proc/net/route scan: %d lookups (%d found), %.1f ms each\n",
+	       nscans, found, secs * 1e3 / nscans);
+
+	return 0;
+}
@@ -18,6 +18,7 @@
  *
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -33,11 +34,432 @@
 
 /* (later: haven't I seen this statement elsewere? hmm...) */
 
+/*
+ * Both caches are a doubly linked LRU list (most recent first) plus a
+ * hash table for lookups.  The ip cache is hashed on the IP address,
+ * the ax25 cache on the callsign.  ip entries are also chained by their
+ * callsign, so that dropping an ax25 route finds the ip routes that use
+ * it without a scan.
+ *
+ * Every entry is also on the LRU list of the partition of its port.
+ * A full port only evicts its own oldest entry, and when the caches as
+ * a whole reach ax25-maxroutes or ip-maxroutes, the port holding the
+ * most entries gives one up.  So a busy user port cannot push the
+ * routes of a quiet backbone port out of the cache.
+ */
+
+static ip_rt_entry *ip_hash[RT_HASHSIZE];
+static ip_rt_entry *ip_call_hash[RT_HASHSIZE];
+
+static ax25_rt_entry *ax25_hash[RT_HASHSIZE];
+
+struct cache_stat ax25_cache_stats, ip_cache_stats;
+
+rt_part *rt_parts;
+
+/*
+ * Entries on ports with an ax25-ttl or ip-ttl sit on a timer wheel,
+ * in the slot of the tick they expire in.  Each tick only the entries
+ * in its slot are looked at; ones due in a later turn of the wheel stay
+ * where they are.
+ */
+
+#define WHEEL_SIZE	512
+#define WHEEL_TICK	10	/* seconds per slot */
+
+#define TIMER_ENTRY(t, type) ((type *) ((char *) (t) - offsetof(type, timer)))
+
+static rt_timer *ip_wheel[WHEEL_SIZE];
+static rt_timer *ax25_wheel[WHEEL_SIZE];
+static time_t wheel_tick;	/* last tick that is completely done */
+static int timers_armed;
+
+static void timer_stop(rt_timer * t)
+{
+	if (t->expires == 0)
+		return;
+
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->expires = 0;
+	timers_armed--;
+}
+
+static void timer_start(rt_timer ** wheel, rt_timer * t, time_t expires)
+{
+	time_t tick = expires / WHEEL_TICK;
+	rt_timer **head;
+
+	timer_stop(t);
+	if (expires == 0)
+		return;
+
+	/* already overdue: take it with the current tick */
+	if (tick <= wheel_tick)
+		tick = wheel_tick + 1;
+
+	head = &wheel[tick % WHEEL_SIZE];
+	t->next = *head;
+	if (*head)
+		(*head)->pprev = &t->next;
+	t->pprev = head;
+	*head = t;
+	t->expires = expires;
+	timers_armed++;
+}
+
+static void ip_arm(config * config, ip_rt_entry * bp)
+{
+	time_t expires = 0;
+
+	if (config != NULL && config->ip_ttl && bp->timestamp)
+		expires = bp->timestamp + config->ip_ttl;
+	timer_start(ip_wheel, &bp->timer, expires);
+}
+
+static void ax25_arm(config * config, ax25_rt_entry * bp)
+{
+	time_t expires = 0;
+
+	if (config != NULL && config->ax25_ttl && bp->timestamp)
+		expires = bp->timestamp + config->ax25_ttl;
+	timer_start(ax25_wheel, &bp->timer, expires);
+}
+
+static unsigned int ip_hashfn(unsigned long ip)
+{
+	return ((unsigned int) ip * 2654435761U) >> 20 & (RT_HASHSIZE - 1);
+}
+
+static unsigned int call_hashfn(ax25_address * call)
+{
+	unsigned int h = 0;
+	int k;
+
+	for (k = 0; k < AXLEN; k++)
+		h = h * 31 + (unsigned char) call->ax25_call[k];
+
+	return (h ^ h >> 12) & (RT_HASHSIZE - 1);
+}
+
+static ip_rt_entry *ip_lookup(unsigned long ip)
+{
+	ip_rt_entry *bp;
+
+	for (bp = ip_hash[ip_hashfn(ip)]; bp; bp = bp->hnext)
+		if (bp->ip == ip)
+			return bp;
+
+	return NULL;
+}
+
+static ax25_rt_entry *ax25_lookup(ax25_address * call)
+{
+	ax25_rt_entry *bp;
+
+	for (bp = ax25_hash[call_hashfn(call)]; bp; bp = bp->hnext)
+		if (!memcmp(call, &bp->call, AXLEN))
+			return bp;
+
+	return NULL;
+}
+
+static void ip_call_link(ip_rt_entry * bp)
+{
+	ip_rt_entry **head = &ip_call_hash[call_hashfn(&bp->call)];
+
+	bp->cprev = NULL;
+	bp->cnext = *head;
+	if (*head)
+		(*head)->cprev = bp;
+	*head = bp;
+}
+
+static void ip_call_unlink(ip_rt_entry * bp)
+{
+	if (bp->cnext)
+		bp->cnext->cprev = bp->cprev;
+	if (bp->cprev)
+		bp->cprev->cnext = bp->cnext;
+	else
+		ip_call_hash[call_hashfn(&bp->call)] = bp->cnext;
+}
+
+static rt_part *part_get(char *dev)
+{
+	rt_part *pt, **pp;
+
+	for (pp = &rt_parts; (pt = *pp) != NULL; pp = &pt->next)
+		if (!strcmp(pt->dev, dev))
+			return pt;
+
+	pt = calloc(1, sizeof(*pt));
+	if (pt == NULL)
+		return NULL;
+	strcpy(pt->dev, dev);
+	*pp = pt;
+	return pt;
+}
+
+rt_part *config_part(config * config)
+{
+	if (config->part == NULL)
+		config->part = part_get(config->dev);
+	return config->part;
+}
+
+static void ip_part_link(ip_rt_entry * bp)
+{
+	rt_part *pt = bp->part;
+
+	bp->pprev = NULL;
+	bp->pnext = pt->ip_head;
+	if (pt->ip_head)
+		pt->ip_head->pprev = bp;
+	else
+		pt->ip_tail = bp;
+	pt->ip_head = bp;
+	pt->ip_cnt++;
+}
+
+static void ip_part_unlink(ip_rt_entry * bp)
+{
+	rt_part *pt = bp->part;
+
+	if (bp->pnext)
+		bp->pnext->pprev = bp->pprev;
+	else
+		pt->ip_tail = bp->pprev;
+	if (bp->pprev)
+		bp->pprev->pnext = bp->pnext;
+	else
+		pt->ip_head = bp->pnext;
+	pt->ip_cnt--;
+}
+
+static void ax25_part_link(ax25_rt_entry * bp)
+{
+	rt_part *pt = bp->part;
+
+	bp->pprev = NULL;
+	bp->pnext = pt->ax25_head;
+	if (pt->ax25_head)
+		pt->ax25_head->pprev = bp;
+	else
+		pt->ax25_tail = bp;
+	pt->ax25_head = bp;
+	pt->ax25_cnt++;
+}
+
+static void ax25_part_unlink(ax25_rt_entry * bp)
+{
+	rt_part *pt = bp->part;
+
+	if (bp->pnext)
+		bp->pnext->pprev = bp->pprev;
+	else
+		pt->ax25_tail = bp->pprev;
+	if (bp->pprev)
+		bp->pprev->pnext = bp->pnext;
+	else
+		pt->ax25_head = bp->pnext;
+	pt->ax25_cnt--;
+}
+
+/* put a new entry at the head of the lists and into the hash tables */
+
+static void ip_link(ip_rt_entry * bp)
+{
+	ip_rt_entry **head = &ip_hash[ip_hashfn(bp->ip)];
+
+	bp->hnext = *head;
+	*head = bp;
+	ip_call_link(bp);
+	ip_part_link(bp);
+
+	bp->prev = NULL;
+	bp->next = ip_routes;
+	if (ip_routes)
+		ip_routes->prev = bp;
+	ip_routes = bp;
+	ip_routes_cnt++;
+}
+
+static void ip_unlink(ip_rt_entry * bp)
+{
+	ip_rt_entry **pp = &ip_hash[ip_hashfn(bp->ip)];
+
+	while (*pp != bp)
+		pp = &(*pp)->hnext;
+	*pp = bp->hnext;
+	ip_call_unlink(bp);
+	ip_part_unlink(bp);
+	timer_stop(&bp->timer);
+
+	if (bp->next)
+		bp->next->prev = bp->prev;
+	if (bp->prev)
+		bp->prev->next = bp->next;
+	else
+		ip_routes = bp->next;
+	ip_routes_cnt--;
+}
+
+static void ip_touch(ip_rt_entry * bp)
+{
+	if (bp != bp->part->ip_head) {
+		ip_part_unlink(bp);
+		ip_part_link(bp);
+	}
+
+	if (bp == ip_routes)
+		return;
+
+	bp->prev->next = bp->next;
+	if (bp->next)
+		bp->next->prev = bp->prev;
+
+	bp->prev = NULL;
+	bp->next = ip_routes;
+	ip_routes->prev = bp;
+	ip_routes = bp;
+}
+
+static void ax25_link(ax25_rt_entry * bp)
+{
+	ax25_rt_entry **head = &ax25_hash[call_hashfn(&bp->call)];
+
+	bp->hnext = *head;
+	*head = bp;
+	ax25_part_link(bp);
+
+	bp->prev = NULL;
+	bp->next = ax25_routes;
+	if (ax25_routes)
+		ax25_routes->prev = bp;
+	ax25_routes = bp;
+	ax25_routes_cnt++;
+}
+
+static void ax25_unlink(ax25_rt_entry * bp)
+{
+	ax25_rt_entry **pp = &ax25_hash[call_hashfn(&bp->call)];
+
+	while (*pp != bp)
+		pp = &(*pp)->hnext;
+	*pp = bp->hnext;
+	ax25_part_unlink(bp);
+	timer_stop(&bp->timer);
+
+	if (bp->next)
+		bp->next->prev = bp->prev;
+	if (bp->prev)
+		bp->prev->next = bp->next;
+	else
+		ax25_routes = bp->next;
+	ax25_routes_cnt--;
+}
+
+static void ax25_touch(ax25_rt_entry * bp)
+{
+	if (bp != bp->part->ax25_head) {
+		ax25_part_unlink(bp);
+		ax25_part_link(bp);
+	}
+
+	if (bp == ax25_routes)
+		return;
+
+	bp->prev->next = bp->next;
+	if (bp->next)
+		bp->next->prev = bp->prev;
+
+	bp->prev = NULL;
+	bp->next = ax25_routes;
+	ax25_routes->prev = bp;
+	ax25_routes = bp;
+}
+
+static int ip_evict(rt_part * pt)
+{
+	ip_rt_entry *bp = pt->ip_tail;
+
+	if (bp == NULL)		/* error */
+		return -1;
+
+	ip_cache_stats.evictions++;
+	pt->ip_evictions++;
+	ip_unlink(bp);
+	journal_ip(J_DEL_IP, bp);	/* a replay need not pick the same one */
+	free(bp);
+	return 0;
+}
+
+static int ax25_evict(rt_part * pt)
+{
+	ax25_rt_entry *bp = pt->ax25_tail;
+
+	if (bp == NULL)		/* error */
+		return -1;
+
+	ax25_cache_stats.evictions++;
+	pt->ax25_evictions++;
+	ax25_unlink(bp);
+	journal_ax25(J_DEL_AX25, bp);	/* a replay need not pick the same one */
+	free(bp);
+	return 0;
+}
+
+/*
+ * Make room for one more entry on pt's port.  A limit lowered by a
+ * reload is caught up with here.  Returns -1 if that is not possible.
+ */
+
+static int ip_make_room(config * config, rt_part * pt)
+{
+	rt_part *p, *most;
+
+	while (config->ip_maxroutes && pt->ip_cnt >= config->ip_maxroutes)
+		if (ip_evict(pt) < 0)
+			return -1;
+
+	while (ip_routes_cnt >= ip_maxroutes) {
+		for (p = most = rt_parts; p; p = p->next)
+			if (p->ip_cnt > most->ip_cnt)
+				most = p;
+		if (ip_evict(most) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int ax25_make_room(config * config, rt_part * pt)
+{
+	rt_part *p, *most;
+
+	while (config->ax25_maxroutes &&
+	       pt->ax25_cnt >= config->ax25_maxroutes)
+		if (ax25_evict(pt) < 0)
+			return -1;
+
+	while (ax25_routes_cnt >= ax25_maxroutes) {
+		for (p = most = rt_parts; p; p = p->next)
+			if (p->ax25_cnt > most->ax25_cnt)
+				most = p;
+		if (ax25_evict(most) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 int update_ip_route(config * config, unsigned long ip, int ipmode,
 		    ax25_address * call, time_t timestamp)
 {
-	ip_rt_entry *bp = ip_routes;
-	ip_rt_entry *bp_prev = ip_routes;
+	ip_rt_entry *bp;
+	rt_part *pt;
 	char *iface;
 	int action = 0;
 
@@ -45,217 +467,296 @@ int update_ip_route(config * config, unsigned long ip, int ipmode,
 		return 0;
 
 	iface = config->dev;
+	pt = config_part(config);
+	if (pt == NULL)
+		return 0;
 
-	while (bp) {
-		if (bp->ip == ip) {
-			if (bp->timestamp == 0 && timestamp != 0)
-				return 0;
-
-			if (strcmp(bp->iface, iface)) {
-				action |= NEW_ROUTE;
-				strcpy(bp->iface, iface);
-			}
-
-			if (memcmp(&bp->call, call, AXLEN)) {
-				action |= NEW_ARP;
-				memcpy(&bp->call, call, AXLEN);
-			}
-
-			if (ipmode != bp->ipmode) {
-				action |= NEW_IPMODE;
-				bp->ipmode = ipmode;
-			}
-
-			bp->timestamp = timestamp;
+	bp = ip_lookup(ip);
+	if (bp) {
+		ip_cache_stats.hits++;
+		if (bp->timestamp == 0 && timestamp != 0)
+			return 0;
 
-			if (bp != ip_routes) {
-				if (bp->next)
-					bp->next->prev = bp->prev;
-				if (bp->prev)
-					bp->prev->next = bp->next;
+		if (strcmp(bp->iface, iface)) {
+			action |= NEW_ROUTE;
+			strcpy(bp->iface, iface);
+			ip_part_unlink(bp);
+			bp->part = pt;
+			ip_part_link(bp);
+		}
 
-				bp->next = ip_routes;
-				bp->prev = NULL;
-				ip_routes->prev = bp;
-				ip_routes = bp;
-			}
+		if (memcmp(&bp->call, call, AXLEN)) {
+			action |= NEW_ARP;
+			ip_call_unlink(bp);
+			memcpy(&bp->call, call, AXLEN);
+			ip_call_link(bp);
+		}
 
-			return action;
+		if (ipmode >= 0 && ipmode != bp->ipmode) {
+			action |= NEW_IPMODE;
+			bp->ipmode = ipmode;
 		}
 
-		bp_prev = bp;
-		bp = bp->next;
+		bp->timestamp = timestamp;
+		ip_touch(bp);
+		ip_arm(config, bp);
+		if (action)
+			journal_ip(J_IP, bp);
+		else
+			journal_ip_heard(bp);
+
+		return action;
 	}
 
-	if (ip_routes_cnt >= ip_maxroutes) {
-		if (bp_prev == NULL)	/* error */
-			return 0;
+	ip_cache_stats.misses++;
 
-		bp_prev->prev->next = NULL;
-		free(bp_prev);
-		ip_routes_cnt--;
-	}
+	if (ip_make_room(config, pt) < 0)
+		return 0;
 
 	bp = (ip_rt_entry *) malloc(sizeof(ip_rt_entry));
 	if (bp == NULL)
 		return 0;
 
-	ip_routes_cnt++;
-	action = NEW_ROUTE | NEW_ARP | NEW_IPMODE;
-	bp->ipmode = ipmode;
+	action = NEW_ENTRY | NEW_ROUTE | NEW_ARP;
+	bp->ipmode = 0;
+	if (ipmode >= 0) {
+		action |= NEW_IPMODE;
+		bp->ipmode = ipmode;
+	}
 	bp->ip = ip;
 	bp->invalid = 0;
+	bp->timer.expires = 0;
 
 	bp->timestamp = timestamp;
 	strcpy(bp->iface, iface);
 	memcpy(&bp->call, call, AXLEN);
+	bp->part = pt;
 
-	if (ip_routes == NULL) {
-		ip_routes = bp;
-		bp->next = bp->prev = NULL;
-		return action;
-	}
-
-	bp->next = ip_routes;
-	bp->prev = NULL;
-	ip_routes->prev = bp;
-	ip_routes = bp;
+	ip_link(bp);
+	ip_arm(config, bp);
+	journal_ip(J_IP, bp);
 
 	return action;
 }
 
-ax25_rt_entry *update_ax25_route(config * config, ax25_address * call,
-				 int ndigi, ax25_address * digi,
-				 time_t timestamp)
+/*
+ * A station is often heard on more than one path, say directly now and
+ * then and through a digipeater most of the time.  Up to AX25_MAXPATHS
+ * of them are kept with a score: frames heard on it (up to a limit),
+ * less a cost per digipeater and a point per minute since it was last
+ * heard.  The path in use is only replaced by one that scores clearly
+ * better, or once it has not been heard for a while.
+ */
+
+#define PATH_HITS_MAX	8
+#define PATH_HIT	4
+#define PATH_HOP_COST	8
+#define PATH_HYSTERESIS	12
+#define PATH_STALE	(30 * 60)
+
+static long path_score(ax25_path * p, time_t now)
 {
-	ax25_rt_entry *bp = ax25_routes;
-	ax25_rt_entry *bp_prev = ax25_routes;
-	char *iface = config->dev;
-	int action = 0;
+	long hits = p->hits < PATH_HITS_MAX ? p->hits : PATH_HITS_MAX;
+	long age = now > p->heard ? (now - p->heard) / 60 : 0;
 
-	while (bp) {
-		if (!memcmp(call, &bp->call, AXLEN)) {
-			if (bp->timestamp == 0 && timestamp != 0)
-				return NULL;
+	return hits * PATH_HIT - p->ndigi * PATH_HOP_COST - age;
+}
 
-			if (strcmp(bp->iface, iface)) {
-				del_kernel_ax25_route(bp->iface,
-						      &bp->call);
-				action |= NEW_ROUTE;
-				strcpy(bp->iface, iface);
-			}
+static int path_equal(ax25_path * p, int ndigi, ax25_address * digi)
+{
+	return p->ndigi == ndigi
+	    && !memcmp(p->digipeater, digi, ndigi * AXLEN);
+}
 
-			if (ndigi != bp->ndigi
-			    || memcmp(bp->digipeater, digi,
-				      bp->ndigi * AXLEN)) {
-				action |= NEW_ROUTE;
-				memcpy(bp->digipeater, digi,
-				       ndigi * AXLEN);
-				bp->ndigi = ndigi;
-			}
+static void path_set(ax25_path * p, int ndigi, ax25_address * digi,
+		     time_t timestamp)
+{
+	memcpy(p->digipeater, digi, ndigi * AXLEN);
+	p->ndigi = ndigi;
+	p->hits = 0;
+	p->heard = timestamp;
+}
 
-			bp->timestamp = timestamp;
+/* only the given path, in use */
 
-			if (bp != ax25_routes) {
-				if (bp->next)
-					bp->next->prev = bp->prev;
-				if (bp->prev)
-					bp->prev->next = bp->next;
+static void ax25_path_reset(ax25_rt_entry * bp, int ndigi,
+			    ax25_address * digi, time_t timestamp)
+{
+	path_set(&bp->path[0], ndigi, digi, timestamp);
+	bp->path[0].hits = 1;
+	bp->npaths = 1;
 
-				bp->next = ax25_routes;
-				bp->prev = NULL;
-				ax25_routes->prev = bp;
-				ax25_routes = bp;
-			}
+	memcpy(bp->digipeater, digi, ndigi * AXLEN);
+	bp->ndigi = ndigi;
+}
 
-			if (action)
-				return bp;
-			else
-				return NULL;
-		}
+/* count a frame heard on this path; returns 1 if the path in use changed */
 
-		bp_prev = bp;
-		bp = bp->next;
+static int ax25_path_heard(ax25_rt_entry * bp, int ndigi,
+			   ax25_address * digi, time_t now)
+{
+	ax25_path *p, *cur = NULL, *best = NULL;
+	int k;
+
+	for (k = 0; k < bp->npaths; k++)
+		if (path_equal(&bp->path[k], bp->ndigi, bp->digipeater))
+			cur = &bp->path[k];
+
+	for (k = 0, p = NULL; k < bp->npaths; k++)
+		if (path_equal(&bp->path[k], ndigi, digi))
+			p = &bp->path[k];
+
+	if (p == NULL) {
+		if (bp->npaths < AX25_MAXPATHS) {
+			p = &bp->path[bp->npaths++];
+		} else {
+			/* replace the worst candidate not in use */
+			for (k = 0; k < bp->npaths; k++)
+				if (&bp->path[k] != cur && (p == NULL ||
+				    path_score(&bp->path[k], now) <
+				    path_score(p, now)))
+					p = &bp->path[k];
+		}
+		path_set(p, ndigi, digi, now);
 	}
 
-	if (ax25_routes_cnt >= ax25_maxroutes) {
-		if (bp_prev == NULL)	/* error */
+	p->hits++;
+	p->heard = now;
+
+	if (p == cur)
+		return 0;
+
+	for (k = 0; k < bp->npaths; k++)
+		if (best == NULL ||
+		    path_score(&bp->path[k], now) > path_score(best, now))
+			best = &bp->path[k];
+
+	if (best == cur)
+		return 0;
+
+	if (cur != NULL && now - cur->heard < PATH_STALE &&
+	    path_score(best, now) < path_score(cur, now) + PATH_HYSTERESIS)
+		return 0;
+
+	memcpy(bp->digipeater, best->digipeater, best->ndigi * AXLEN);
+	bp->ndigi = best->ndigi;
+	return 1;
+}
+
+/*
+ * Learn that call was heard on config's port via the given digipeaters.
+ * With force, that path is used right away and other candidates are
+ * forgotten, as for routes added by hand or loaded from the cache.
+ */
+
+ax25_rt_entry *update_ax25_route(config * config, ax25_address * call,
+				 int ndigi, ax25_address * digi,
+				 time_t timestamp, int force)
+{
+	ax25_rt_entry *bp;
+	rt_part *pt;
+	char *iface = config->dev;
+	int action = 0;
+
+	pt = config_part(config);
+	if (pt == NULL)
+		return NULL;
+
+	bp = ax25_lookup(call);
+	if (bp) {
+		ax25_cache_stats.hits++;
+		if (bp->timestamp == 0 && timestamp != 0)
 			return NULL;
 
-		bp_prev->prev->next = NULL;
-		free(bp_prev);
-		ax25_routes_cnt--;
+		if (strcmp(bp->iface, iface)) {
+			del_kernel_ax25_route(bp->iface, &bp->call);
+			action |= NEW_ROUTE;
+			strcpy(bp->iface, iface);
+			ax25_part_unlink(bp);
+			bp->part = pt;
+			ax25_part_link(bp);
+			force = 1;
+		}
+
+		if (force) {
+			if (ndigi != bp->ndigi ||
+			    memcmp(bp->digipeater, digi, ndigi * AXLEN))
+				action |= NEW_ROUTE;
+			ax25_path_reset(bp, ndigi, digi, timestamp);
+		} else if (ax25_path_heard(bp, ndigi, digi, timestamp))
+			action |= NEW_ROUTE;
+
+		bp->cnt++;
+		bp->timestamp = timestamp;
+		ax25_touch(bp);
+		ax25_arm(config, bp);
+		if (action)
+			journal_ax25(J_AX25, bp);
+		else
+			journal_ax25_heard(bp);
+
+		if (action)
+			return bp;
+		else
+			return NULL;
 	}
 
+	ax25_cache_stats.misses++;
+
+	if (ax25_make_room(config, pt) < 0)
+		return NULL;
+
 	bp = (ax25_rt_entry *) malloc(sizeof(ax25_rt_entry));
 	if (bp == NULL)
 		return NULL;
 
-	ax25_routes_cnt++;
-
 	bp->timestamp = timestamp;
+	bp->timer.expires = 0;
 	strcpy(bp->iface, iface);
 	bp->call = *call;
+	bp->cnt = 1;
+	bp->part = pt;
 
-	if (ndigi)
-		memcpy(bp->digipeater, digi, ndigi * AXLEN);
-
-	bp->ndigi = ndigi;
+	ax25_path_reset(bp, ndigi, digi, timestamp);
 
-	if (ax25_routes == NULL) {
-		ax25_routes = bp;
-		bp->next = bp->prev = NULL;
-		return bp;
-	}
-
-	bp->next = ax25_routes;
-	bp->prev = NULL;
-	ax25_routes->prev = bp;
-	ax25_routes = bp;
+	ax25_link(bp);
+	ax25_arm(config, bp);
+	journal_ax25(J_AX25, bp);
 
 	return bp;
 }
 
 static ip_rt_entry *remove_ip_route(ip_rt_entry * bp)
 {
-	ip_rt_entry *bp2;
-
-	bp2 = bp->next;
-	if (bp2)
-		bp2->prev = bp->prev;
-	if (bp->prev)
-		bp->prev->next = bp2;
-	if (bp == ip_routes)
-		ip_routes = bp2;
+	ip_rt_entry *bp2 = bp->next;
 
+	ip_unlink(bp);
+	journal_ip(J_DEL_IP, bp);
 	del_kernel_ip_route(bp->iface, bp->ip);
 
 	free(bp);
-	ip_routes_cnt--;
 	return bp2;
 }
 
 static ax25_rt_entry *remove_ax25_route(ax25_rt_entry * bp)
 {
 	ax25_rt_entry *bp2;
-	ip_rt_entry *iprt;
+	ip_rt_entry *iprt, *iprt2;
 
+	ax25_unlink(bp);
 	bp2 = bp->next;
-	if (bp2)
-		bp2->prev = bp->prev;
-	if (bp->prev)
-		bp->prev->next = bp2;
-	if (bp == ax25_routes)
-		ax25_routes = bp2;
 
-	for (iprt = ip_routes; iprt; iprt = iprt->next)
+	/* drop the ip routes via this call */
+	for (iprt = ip_call_hash[call_hashfn(&bp->call)]; iprt; iprt = iprt2) {
+		iprt2 = iprt->cnext;
 		if (!memcmp(&iprt->call, &bp->call, AXLEN))
 			remove_ip_route(iprt);
+	}
 
+	journal_ax25(J_DEL_AX25, bp);
 	del_kernel_ax25_route(bp->iface, &bp->call);
 
 	free(bp);
-	ax25_routes_cnt--;
 	return bp2;
 }
 
@@ -266,40 +767,67 @@ int del_ip_route(unsigned long ip)
 	if (ip == 0)
 		return 1;
 
-	for (bp = ip_routes; bp; bp = bp->next)
-		if (bp->ip == ip) {
-			remove_ip_route(bp);
-			return 0;
-		}
+	bp = ip_lookup(ip);
+	if (bp == NULL)
+		return 1;
 
-	return 1;
+	remove_ip_route(bp);
+	return 0;
 }
 
 int invalidate_ip_route(unsigned long ip)
 {
 	ip_rt_entry *bp;
 
-	for (bp = ip_routes; bp; bp = bp->next)
-		if (bp->ip == ip) {
-			bp->invalid = 1;
-			return 1;
-		}
+	bp = ip_lookup(ip);
+	if (bp == NULL)
+		return 0;
 
-	return 0;
+	bp->invalid = 1;
+	journal_ip(J_INVALID_IP, bp);
+	return 1;
 }
 
 int del_ax25_route(config * config, ax25_address * call)
 {
 	ax25_rt_entry *bp;
 
-	for (bp = ax25_routes; bp; bp = bp->next)
-		if (!memcmp(call, &bp->call, AXLEN)
-		    && !strcmp(config->dev, bp->iface)) {
-			remove_ax25_route(bp);
-			return 0;
-		}
+	bp = ax25_lookup(call);
+	if (bp == NULL || strcmp(config->dev, bp->iface))
+		return 1;
 
-	return 1;
+	remove_ax25_route(bp);
+	return 0;
+}
+
+/*
+ * Drop an entry from the cache only, for a delete record in the
+ * journal: the kernel was told before the crash, and the ip routes via
+ * a removed call have their own records.  An evicted call keeps them.
+ */
+
+void forget_ip_route(unsigned long ip)
+{
+	ip_rt_entry *bp;
+
+	bp = ip_lookup(ip);
+	if (bp == NULL)
+		return;
+
+	ip_unlink(bp);
+	free(bp);
+}
+
+void forget_ax25_route(ax25_address * call)
+{
+	ax25_rt_entry *bp;
+
+	bp = ax25_lookup(call);
+	if (bp == NULL)
+		return;
+
+	ax25_unlink(bp);
+	free(bp);
 }
 
 void expire_ax25_route(time_t when)
@@ -308,9 +836,10 @@ void expire_ax25_route(time_t when)
 	time_t now = time(NULL);
 
 	for (bp = ax25_routes; bp;)
-		if (bp->timestamp != 0 && bp->timestamp + when <= now)
+		if (bp->timestamp != 0 && bp->timestamp + when <= now) {
+			ax25_cache_stats.expired++;
 			bp = remove_ax25_route(bp);
-		else
+		} else
 			bp = bp->next;
 }
 
@@ -320,8 +849,130 @@ void expire_ip_route(time_t when)
 	time_t now = time(NULL);
 
 	for (bp = ip_routes; bp;)
-		if (bp->timestamp != 0 && bp->timestamp + when <= now)
+		if (bp->timestamp != 0 && bp->timestamp + when <= now) {
+			ip_cache_stats.expired++;
 			bp = remove_ip_route(bp);
-		else
+		} else
 			bp = bp->next;
 }
+
+/*
+ * Paged listings walk the caches in hash order, and by key within a
+ * bucket.  Unlike the LRU order that does not change as entries are
+ * heard, so the last key returned is all a cursor needs to be.
+ */
+
+ax25_rt_entry *ax25_route_after(ax25_address * call)
+{
+	ax25_rt_entry *bp, *best;
+	unsigned int h = 0;
+
+	if (call != NULL)
+		h = call_hashfn(call);
+
+	for (; h < RT_HASHSIZE; h++, call = NULL) {
+		best = NULL;
+		for (bp = ax25_hash[h]; bp; bp = bp->hnext) {
+			if (call != NULL && memcmp(&bp->call, call, AXLEN) <= 0)
+				continue;
+			if (best == NULL
+			    || memcmp(&bp->call, &best->call, AXLEN) < 0)
+				best = bp;
+		}
+		if (best != NULL)
+			return best;
+	}
+
+	return NULL;
+}
+
+ip_rt_entry *ip_route_after(unsigned long *ip)
+{
+	ip_rt_entry *bp, *best;
+	unsigned int h = 0;
+
+	if (ip != NULL)
+		h = ip_hashfn(*ip);
+
+	for (; h < RT_HASHSIZE; h++, ip = NULL) {
+		best = NULL;
+		for (bp = ip_hash[h]; bp; bp = bp->hnext) {
+			if (ip != NULL && bp->ip <= *ip)
+				continue;
+			if (best == NULL || bp->ip < best->ip)
+				best = bp;
+		}
+		if (best != NULL)
+			return best;
+	}
+
+	return NULL;
+}
+
+/* the TTLs may have changed with the config */
+
+void rearm_timers(void)
+{
+	ax25_rt_entry *ax;
+	ip_rt_entry *ip;
+
+	for (ax = ax25_routes; ax; ax = ax->next)
+		ax25_arm(dev_get_config(ax->iface), ax);
+
+	for (ip = ip_routes; ip; ip = ip->next)
+		ip_arm(dev_get_config(ip->iface), ip);
+}
+
+/*
+ * Expire what is due.  Returns the number of seconds until the next
+ * slot with entries in it, or -1 if no entry is armed.
+ */
+
+int run_timers(void)
+{
+	time_t now = time(NULL), tick = now / WHEEL_TICK;
+	rt_timer *t, *next;
+	int k, n, slot;
+
+	n = tick - wheel_tick;
+	if (n > WHEEL_SIZE)
+		n = WHEEL_SIZE;
+
+	for (k = 1; k <= n && timers_armed; k++) {
+		slot = (wheel_tick + k) % WHEEL_SIZE;
+
+		for (t = ax25_wheel[slot]; t; t = next) {
+			next = t->next;
+			if (t->expires <= now) {
+				ax25_cache_stats.expired++;
+				remove_ax25_route(TIMER_ENTRY(t, ax25_rt_entry));
+			}
+		}
+
+		for (t = ip_wheel[slot]; t; t = next) {
+			next = t->next;
+			if (t->expires <= now) {
+				ip_cache_stats.expired++;
+				remove_ip_route(TIMER_ENTRY(t, ip_rt_entry));
+			}
+		}
+	}
+	/* the current tick is not over yet, look at it again next time */
+	wheel_tick = tick - 1;
+
+	if (timers_armed == 0)
+		return -1;
+
+	/* entries still in the current slot are due by the end of it */
+	slot = tick % WHEEL_SIZE;
+	if (ax25_wheel[slot] || ip_wheel[slot])
+		return (tick + 1) * WHEEL_TICK - now;
+
+	for (k = 1; k < WHEEL_SIZE; k++) {
+		slot = (tick + k) % WHEEL_SIZE;
+		if (ax25_wheel[slot] || ip_wheel[slot])
+			break;
+	}
+
+	return (tick + k) * WHEEL_TICK - now;
+}
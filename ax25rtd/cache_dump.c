@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <sys/types.h>
@@ -33,87 +34,366 @@
 
 #include "ax25rtd.h"
 
-void dump_ip_routes(int fd, int cmd)
+/*
+ * Lines are collected in obuf and handed to ctl_write() a few kilobytes
+ * at a time.
+ */
+
+#define OUT_LIST	0	/* "list" output, port names */
+#define OUT_CMD		1	/* "add" commands for the cache files */
+#define OUT_JSON	2	/* one JSON object per line */
+
+static char obuf[4096];
+static int olen;
+
+static void out_flush(int fd)
+{
+	if (olen)
+		ctl_write(fd, obuf, olen);
+	olen = 0;
+}
+
+/* room for at least one more line */
+static char *out_line(int fd)
+{
+	if (olen > (int) sizeof(obuf) - 512)
+		out_flush(fd);
+	return obuf + olen;
+}
+
+static char *port_name(char *iface, int how)
 {
-	ip_rt_entry *bp;
 	config *config;
-	char buf[256], *dev;
-	unsigned long ip;
-	int len;
-
-	for (bp = ip_routes; bp; bp = bp->next) {
-		ip = htonl(bp->ip);
-
-		if (cmd) {
-			len = sprintf(buf, "add ip ");
-			dev = bp->iface;
-		} else {
-			len = 0;
-			config = dev_get_config(bp->iface);
-			if (config != NULL)
-				dev = config->port;
-			else
-				dev = bp->iface;
+
+	if (how == OUT_CMD)
+		return iface;
+
+	config = dev_get_config(iface);
+	if (config != NULL)
+		return config->port;
+	return iface;
+}
+
+static char *ip_string(unsigned long ip)
+{
+	static char buf[16];
+
+	ip = htonl(ip);
+	sprintf(buf, "%d.%d.%d.%d",
+		(int) ((ip & 0xFF000000) >> 24),
+		(int) ((ip & 0x00FF0000) >> 16),
+		(int) ((ip & 0x0000FF00) >> 8),
+		(int) (ip & 0x000000FF));
+	return buf;
+}
+
+static int fmt_ip(char *buf, ip_rt_entry * bp, int how)
+{
+	char mode;
+	int len = 0;
+
+	if (bp->invalid)
+		mode = 'X';
+	else
+		mode = bp->ipmode ? 'v' : 'd';
+
+	if (how == OUT_JSON) {
+		len = sprintf(buf, "{\"ip\":\"%s\",\"port\":\"%s\",",
+			      ip_string(bp->ip), port_name(bp->iface, how));
+		return len + sprintf(buf + len,
+				     "\"call\":\"%s\",\"mode\":\"%c\",\"time\":%ld}\n",
+				     ax25_ntoa(&bp->call), mode,
+				     (long) bp->timestamp);
+	}
+
+	if (how == OUT_CMD)
+		len = sprintf(buf, "add ip ");
+
+	len += sprintf(buf + len, "%s", ip_string(bp->ip));
+	len += sprintf(buf + len, " %-4s %8.8lx %-9s %c\n",
+		       port_name(bp->iface, how), bp->timestamp,
+		       ax25_ntoa(&bp->call), mode);
+	return len;
+}
+
+static int fmt_ax25(char *buf, ax25_rt_entry * bp, int how)
+{
+	int k, len = 0;
+
+	if (how == OUT_JSON) {
+		len = sprintf(buf, "{\"call\":\"%s\",", ax25_ntoa(&bp->call));
+		len += sprintf(buf + len, "\"port\":\"%s\",\"time\":%ld,\"path\":[",
+			       port_name(bp->iface, how), (long) bp->timestamp);
+		for (k = 0; k < bp->ndigi; k++)
+			len += sprintf(buf + len, "%s\"%s\"", k ? "," : "",
+				       ax25_ntoa(&bp->digipeater[k]));
+		return len + sprintf(buf + len, "]}\n");
+	}
+
+	if (how == OUT_CMD)
+		len = sprintf(buf, "add ax25 ");
+
+	len += sprintf(buf + len, "%-9s %-4s %8.8lx",
+		       ax25_ntoa(&bp->call), port_name(bp->iface, how),
+		       bp->timestamp);
+
+	for (k = 0; k < bp->ndigi; k++)
+		len += sprintf(buf + len, " %s",
+			       ax25_ntoa(&bp->digipeater[k]));
+	return len + sprintf(buf + len, "\n");
+}
+
+static void fmt_next(int fd, char *cursor, int how)
+{
+	char *p = out_line(fd);
+
+	if (how == OUT_JSON)
+		olen += sprintf(p, "{\"next\":\"%s\"}\n", cursor);
+	else
+		olen += sprintf(p, "next %s\n", cursor);
+}
+
+static int match(list_filter * f, time_t since, char *iface,
+		 ax25_address * call, time_t timestamp)
+{
+	if (f->config != NULL && strcmp(iface, f->config->dev))
+		return 0;
+	if (since && timestamp != 0 && timestamp < since)
+		return 0;
+	if (*f->call && strncmp(ax25_ntoa(call), f->call, strlen(f->call)))
+		return 0;
+	return 1;
+}
+
+/*
+ * Without a page size or cursor the whole cache is listed, most
+ * recently heard first; pages come in the order of ip_route_after().
+ * A port filter walks the list of that port only.
+ */
+
+void list_ip_routes(int fd, list_filter * f)
+{
+	ip_rt_entry *bp, *last = NULL;
+	int paged = f->count || f->after;
+	int how = f->json ? OUT_JSON : OUT_LIST;
+	time_t since = 0;
+	int n = 0;
+
+	if (f->age)
+		since = time(NULL) - f->age * 60;
+
+	if (paged)
+		bp = ip_route_after(f->after ? &f->after_ip : NULL);
+	else if (f->config != NULL)
+		bp = config_part(f->config) ? f->config->part->ip_head : NULL;
+	else
+		bp = ip_routes;
+
+	for (; bp; bp = paged ? ip_route_after(&bp->ip) :
+	     f->config ? bp->pnext : bp->next) {
+		if (!match(f, since, bp->iface, &bp->call, bp->timestamp))
+			continue;
+		if (f->ipmode != -1 && (bp->invalid || bp->ipmode != f->ipmode))
+			continue;
+
+		if (f->count && n == f->count) {
+			fmt_next(fd, ip_string(last->ip), how);
+			break;
+		}
+
+		olen += fmt_ip(out_line(fd), bp, how);
+		last = bp;
+		n++;
+	}
+
+	olen += sprintf(out_line(fd), ".\n");
+	out_flush(fd);
+}
+
+void list_ax25_routes(int fd, list_filter * f)
+{
+	ax25_rt_entry *bp, *last = NULL;
+	int paged = f->count || f->after;
+	int how = f->json ? OUT_JSON : OUT_LIST;
+	time_t since = 0;
+	int n = 0;
+
+	if (f->age)
+		since = time(NULL) - f->age * 60;
+
+	if (paged)
+		bp = ax25_route_after(f->after ? &f->after_call : NULL);
+	else if (f->config != NULL)
+		bp = config_part(f->config) ? f->config->part->ax25_head : NULL;
+	else
+		bp = ax25_routes;
+
+	for (; bp; bp = paged ? ax25_route_after(&bp->call) :
+	     f->config ? bp->pnext : bp->next) {
+		if (!match(f, since, bp->iface, &bp->call, bp->timestamp))
+			continue;
+
+		if (f->count && n == f->count) {
+			fmt_next(fd, ax25_ntoa(&last->call), how);
+			break;
 		}
 
-		len += sprintf(buf + len, "%d.%d.%d.%d",
-			       (int) ((ip & 0xFF000000) >> 24),
-			       (int) ((ip & 0x00FF0000) >> 16),
-			       (int) ((ip & 0x0000FF00) >> 8),
-			       (int) (ip & 0x000000FF));
-
-		len +=
-		    sprintf(buf + len, " %-4s %8.8lx %-9s ", dev,
-			    bp->timestamp, ax25_ntoa(&bp->call));
-		if (bp->invalid)
-			len += sprintf(buf + len, "X\n");
-		else
-			len +=
-			    sprintf(buf + len, "%c\n",
-				    bp->ipmode ? 'v' : 'd');
-
-		write(fd, buf, len);
+		olen += fmt_ax25(out_line(fd), bp, how);
+		last = bp;
+		n++;
 	}
 
-	if (!cmd)
-		write(fd, ".\n", 2);
+	olen += sprintf(out_line(fd), ".\n");
+	out_flush(fd);
+}
 
+static void list_all(list_filter * f)
+{
+	memset(f, 0, sizeof(*f));
+	f->ipmode = -1;
+}
+
+void dump_ip_routes(int fd, int cmd)
+{
+	ip_rt_entry *bp;
+	list_filter f;
+
+	if (!cmd) {
+		list_all(&f);
+		list_ip_routes(fd, &f);
+		return;
+	}
+
+	for (bp = ip_routes; bp; bp = bp->next)
+		olen += fmt_ip(out_line(fd), bp, OUT_CMD);
+	out_flush(fd);
 }
 
 void dump_ax25_routes(int fd, int cmd)
 {
 	ax25_rt_entry *bp;
+	list_filter f;
+
+	if (!cmd) {
+		list_all(&f);
+		list_ax25_routes(fd, &f);
+		return;
+	}
+
+	for (bp = ax25_routes; bp; bp = bp->next)
+		olen += fmt_ax25(out_line(fd), bp, OUT_CMD);
+	out_flush(fd);
+}
+
+static char *limit(int max)
+{
+	static char buf[16];
+
+	if (max == 0)
+		return "-";
+	sprintf(buf, "%d", max);
+	return buf;
+}
+
+static void fmt_port(int fd, char *port, rt_part * pt, config * config)
+{
+	char *p = out_line(fd);
+
+	p += sprintf(p, "%s %s %d %s %lu ", port, pt->dev, pt->ax25_cnt,
+		     limit(config ? config->ax25_maxroutes : 0),
+		     pt->ax25_evictions);
+	p += sprintf(p, "%d %s %lu\n", pt->ip_cnt,
+		     limit(config ? config->ip_maxroutes : 0),
+		     pt->ip_evictions);
+	olen = p - obuf;
+}
+
+/*
+ * "ports": entries, limit and evictions of each cache per port, then
+ * the totals and the global limits.  Devices that have gone from the
+ * configuration but still have entries come last.
+ */
+
+void list_ports(int fd)
+{
 	config *config;
-	char buf[256], *dev;
-	int k, len;
-
-	for (bp = ax25_routes; bp; bp = bp->next) {
-		if (cmd) {
-			len = sprintf(buf, "add ax25 ");
-			dev = bp->iface;
-		} else {
-			len = 0;
-			config = dev_get_config(bp->iface);
-			if (config != NULL)
-				dev = config->port;
-			else
-				dev = bp->iface;
-		}
+	rt_part *pt;
 
-		len +=
-		    sprintf(buf + len, "%-9s %-4s %8.8lx",
-			    ax25_ntoa(&bp->call), dev, bp->timestamp);
+	for (config = Configs->list; config; config = config->next)
+		if ((pt = config_part(config)) != NULL)
+			fmt_port(fd, config->port, pt, config);
 
-		for (k = 0; k < bp->ndigi; k++)
-			len +=
-			    sprintf(buf + len, " %s",
-				    ax25_ntoa(&bp->digipeater[k]));
-		len += sprintf(buf + len, "\n");
-		write(fd, buf, len);
+	for (pt = rt_parts; pt; pt = pt->next)
+		if (dev_get_config(pt->dev) == NULL &&
+		    (pt->ax25_cnt || pt->ip_cnt))
+			fmt_port(fd, pt->dev, pt, NULL);
+
+	olen += sprintf(out_line(fd), "total - %d %d %lu %d %d %lu\n",
+			ax25_routes_cnt, ax25_maxroutes,
+			ax25_cache_stats.evictions, ip_routes_cnt,
+			ip_maxroutes, ip_cache_stats.evictions);
+	olen += sprintf(out_line(fd), ".\n");
+	out_flush(fd);
+}
+
+static void fmt_cache(int fd, char *name, struct cache_stat *st, int cnt,
+		      int max)
+{
+	olen += sprintf(out_line(fd), "cache %s entries %d limit %d "
+			"hits %lu misses %lu evictions %lu expired %lu\n",
+			name, cnt, max, st->hits, st->misses, st->evictions,
+			st->expired);
+}
+
+/*
+ * "stats": counters since the daemon was started, a line each for the
+ * frames heard, the two caches and every kind of kernel change, as
+ * name/value pairs after the first word or two.  Latencies are in
+ * microseconds.
+ */
+
+void list_stats(int fd)
+{
+	static const char *names[KOP_MAX] = {
+		[KOP_AX25_ADD] = "ax25-add",
+		[KOP_AX25_DEL] = "ax25-del",
+		[KOP_IP_ADD] = "route-add",
+		[KOP_IP_DEL] = "route-del",
+		[KOP_ARP] = "arp",
+		[KOP_IPMODE] = "ipmode",
+	};
+	struct kern_stat *ks;
+	int k;
+
+	pkt_stats();
+
+	olen += sprintf(out_line(fd), "uptime %ld\n",
+			(long) (time(NULL) - started));
+	olen += sprintf(out_line(fd), "frames %lu no-config %lu "
+			"bad-frame %lu bad-address %lu not-digipeated %lu "
+			"ring-drops %lu\n", frame_stats.frames,
+			frame_stats.no_config, frame_stats.bad_frame,
+			frame_stats.bad_addr, frame_stats.not_digipeated,
+			frame_stats.ring_drops);
+
+	fmt_cache(fd, "ax25", &ax25_cache_stats, ax25_routes_cnt,
+		  ax25_maxroutes);
+	fmt_cache(fd, "ip", &ip_cache_stats, ip_routes_cnt, ip_maxroutes);
+
+	for (k = 0; k < KOP_MAX; k++) {
+		ks = &kern_stats[k];
+		olen += sprintf(out_line(fd), "kernel %s queued %lu "
+				"merged %lu issued %lu retried %lu failed %lu "
+				"usec-avg %lu usec-max %lu\n", names[k],
+				ks->queued, ks->merged, ks->applied,
+				ks->retried, ks->failed,
+				ks->timed ? (unsigned long) (ks->usec /
+							     ks->timed) : 0,
+				ks->usec_max);
 	}
 
-	if (!cmd)
-		write(fd, ".\n", 2);
+	olen += sprintf(out_line(fd), ".\n");
+	out_flush(fd);
 }
 
 void dump_config(int fd)
@@ -122,7 +402,7 @@ void dump_config(int fd)
 	int k;
 
 	fprintf(stderr, "config:\n");
-	for (config = Config; config; config = config->next) {
+	for (config = Configs->list; config; config = config->next) {
 		fprintf(stderr, "Device           = %s\n", config->dev);
 		fprintf(stderr, "Port             = %s\n", config->port);
 		fprintf(stderr, "ax25_add_route   = %d\n",
@@ -137,6 +417,10 @@ void dump_config(int fd)
 			config->ip_add_arp);
 		fprintf(stderr, "ip_adjust_mode   = %d\n",
 			config->ip_adjust_mode);
+		fprintf(stderr, "ax25_maxroutes   = %d\n",
+			config->ax25_maxroutes);
+		fprintf(stderr, "ip_maxroutes     = %d\n",
+			config->ip_maxroutes);
 		fprintf(stderr, "netmask          = %8.8lx\n",
 			config->netmask);
 		fprintf(stderr, "ip               = %8.8lx\n", config->ip);
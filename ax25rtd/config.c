@@ -36,6 +36,8 @@
 #include <linux/if_ether.h>
 #endif
 #include <net/if_arp.h>
+#include <ifaddrs.h>
+#include <linux/if_packet.h>
 
 #include <config.h>
 #include <netax25/ax25.h>
@@ -140,86 +142,84 @@ static ax25_address *get_mycall(char *port)
 	return asc2ax(addr);
 }
 
-static void load_ports(void)
-{
-	config *config, *cfg, *ncfg;
-	char buf[1024];
-	struct ifconf ifc;
-	struct ifreq ifr, *ifrp;
-	int k, fd;
+/*
+ * Find the interface of every port.  getifaddrs() gets all interfaces
+ * and their addresses in one netlink dump, however many there are,
+ * instead of an ioctl or three per interface.
+ */
 
-	fd = socket(AF_INET, SOCK_DGRAM, 0);
-	if (fd < 0) {
-		fprintf(stderr, "Unable to open socket\n");
-		exit(1);
-	}
+static int load_ports(config_set *set)
+{
+	struct ifaddrs *ifaddrs, *ifa;
+	struct sockaddr_ll *sll;
+	config *config, **pp;
 
-	ifc.ifc_len = sizeof(buf);
-	ifc.ifc_buf = buf;
-	if (ioctl(fd, SIOCGIFCONF, &ifc) < 0) {
-		fprintf(stderr, "SIOCGIFCONF: %s\n", strerror(errno));
-		return;
+	if (getifaddrs(&ifaddrs) < 0) {
+		fprintf(stderr, "getifaddrs: %s\n", strerror(errno));
+		return -1;
 	}
 
-	ifrp = ifc.ifc_req;
-	for (k = ifc.ifc_len / sizeof(struct ifreq); k > 0; k--, ifrp++) {
-		strcpy(ifr.ifr_name, ifrp->ifr_name);
-		if (strcmp(ifr.ifr_name, "lo") == 0)
+	for (ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL
+		    || ifa->ifa_addr->sa_family != AF_PACKET
+		    || !(ifa->ifa_flags & IFF_UP))
 			continue;
 
-		if (ioctl(fd, SIOCGIFFLAGS, &ifr) < 0) {
-			fprintf(stderr, "SIOCGIFFLAGS: %s\n",
-				strerror(errno));
-			exit(1);
-		}
-
-		if (!(ifr.ifr_flags & IFF_UP))
+		sll = (struct sockaddr_ll *) ifa->ifa_addr;
+		if (sll->sll_hatype != ARPHRD_AX25 || sll->sll_halen < AXLEN)
 			continue;
 
-		ioctl(fd, SIOCGIFHWADDR, &ifr);
+		for (config = set->list; config; config = config->next)
+			if (!memcmp
+			    (&config->mycalls[0], sll->sll_addr, AXLEN)
+			    && !*config->dev) {
+				strncpy(config->dev, ifa->ifa_name,
+					sizeof(config->dev) - 1);
+				config->ifindex = sll->sll_ifindex;
+				break;
+			}
+	}
 
-		if (ifr.ifr_hwaddr.sa_family != ARPHRD_AX25)
+	for (ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL
+		    || ifa->ifa_addr->sa_family != AF_INET)
 			continue;
 
-		for (config = Config; config; config = config->next)
-			if (!memcmp
-			    (&config->mycalls[0], ifr.ifr_hwaddr.sa_data,
-			     AXLEN) && !*config->dev) {
-				strcpy(config->dev, ifr.ifr_name);
-				ioctl(fd, SIOCGIFADDR, &ifr);
+		for (config = set->list; config; config = config->next)
+			if (!strcmp(config->dev, ifa->ifa_name)
+			    && config->ip == 0) {
 				config->ip =
-				    ((struct sockaddr_in *) &ifr.
-				     ifr_addr)->sin_addr.s_addr;
-				strcpy(ifr.ifr_name, config->dev);
-				ioctl(fd, SIOCGIFNETMASK, &ifr);
-				config->netmask =
-				    ((struct sockaddr_in *) &ifr.
-				     ifr_netmask)->sin_addr.s_addr;
-				break;
+				    ((struct sockaddr_in *) ifa->ifa_addr)->
+				    sin_addr.s_addr;
+				if (ifa->ifa_netmask != NULL)
+					config->netmask =
+					    ((struct sockaddr_in *)
+					     ifa->ifa_netmask)->sin_addr.
+					    s_addr;
 			}
 	}
-	close(fd);
 
-	config = cfg = Config;
+	freeifaddrs(ifaddrs);
 
-	while (config) {
-		if (!*config->dev) {
-			if (config == Config) {
-				Config = config->next;
-				cfg = Config;
-			} else
-				cfg->next = config->next;
-			ncfg = config->next;
+	/* drop the ports that have no interface, unless replaying */
+
+	pp = &set->list;
+	while ((config = *pp) != NULL) {
+		if (!*config->dev && replaying) {
+			snprintf(config->dev, sizeof(config->dev), "%.13s",
+				 config->port);
+			pp = &config->next;
+		} else if (!*config->dev) {
+			*pp = config->next;
 			free(config);
-			config = ncfg;
-		} else {
-			cfg = config;
-			config = config->next;
-		}
+		} else
+			pp = &config->next;
 	}
+
+	return 0;
 }
 
-static void load_listeners(void)
+static int load_listeners(config_set *set)
 {
 	config *config;
 	char buf[1024], device[14], call[10], dcall[10];
@@ -231,19 +231,21 @@ static void load_listeners(void)
 	fp = fopen(PROC_AX25_FILE, "r");
 
 	if (fp == NULL) {
+		if (replaying)
+			return 0;
 		fprintf(stderr, "No AX.25 in kernel. Tss, tss...\n");
-		exit(1);
+		return -1;
 	}
 
 	while (fgets(buf, sizeof(buf) - 1, fp) != NULL) {
-		k = sscanf(buf, "%s %s %s %s", dummy, device, call, dcall);
+		k = sscanf(buf, "%s %13s %9s %9s", dummy, device, call, dcall);
 		if (k == 4 && !strcmp(dcall, "*")) {
 			axcall = asc2ax(call);
 			if (!strcmp("*", device)) {
-				for (config = Config; config;
+				for (config = set->list; config;
 				     config = config->next) {
 					if (call_is_mycall(config, axcall)
-					    || config->nmycalls >
+					    || config->nmycalls >=
 					    AX25_MAXCALLS)
 						continue;
 					memcpy(&config->
@@ -251,10 +253,10 @@ static void load_listeners(void)
 					       axcall, AXLEN);
 				}
 			} else {
-				config = dev_get_config(device);
+				config = set_dev_get_config(set, device);
 				if (config == NULL
 				    || call_is_mycall(config, axcall)
-				    || config->nmycalls > AX25_MAXCALLS)
+				    || config->nmycalls >= AX25_MAXCALLS)
 					continue;
 
 				memcpy(&config->
@@ -264,13 +266,28 @@ static void load_listeners(void)
 		}
 	}
 	fclose(fp);
+	return 0;
 }
 
-void load_config(void)
+static void free_config(config_set *set)
+{
+	config *config, *cfg;
+
+	for (config = set->list; config; config = cfg) {
+		cfg = config->next;
+		free(config);
+	}
+	free(set);
+}
+
+/* read the config file into a new set, without touching the current one */
+
+static config_set *parse_config(void)
 {
 	FILE *fp;
 	char buf[1024], *p, *cmd, *arg;
 	config *config, *cfg;
+	config_set *set;
 	ax25_address *axcall;
 
 	config = NULL;
@@ -280,9 +297,21 @@ void load_config(void)
 	if (fp == NULL) {
 		fprintf(stderr, "config file %s not found\n",
 			CONF_AX25ROUTED_FILE);
+		return NULL;
+	}
+
+	set = calloc(1, sizeof(config_set));
+	if (set == NULL) {
+		fprintf(stderr, "out of memory\n");
 		exit(1);
 	}
 
+	/* options not in the file keep their current values */
+	strcpy(set->ip_encaps_dev, ip_encaps_dev);
+	strcpy(set->iproute2_table, iproute2_table);
+	set->ip_maxroutes = ip_maxroutes;
+	set->ax25_maxroutes = ax25_maxroutes;
+
 	while (fgets(buf, sizeof(buf) - 1, fp) != NULL) {
 		p = prepare_cmdline(buf);
 		if (!*p)
@@ -319,7 +348,7 @@ void load_config(void)
 			if (config)
 				config->next = cfg;
 			else
-				Config = cfg;
+				set->list = cfg;
 
 			cfg->next = NULL;
 			config = cfg;
@@ -412,6 +441,32 @@ void load_config(void)
 				}
 			} else
 				missing_arg(cmd);
+		} else if (config && !strcmp(cmd, "ax25-ttl")) {
+			/* ax25-ttl <minutes>: expire ax25 routes, 0 = never */
+			if (arg) {
+				int k = atoi(arg);
+
+				if (k < 0) {
+					invalid_arg(cmd, arg);
+					continue;
+				} else {
+					config->ax25_ttl = k * 60;
+				}
+			} else
+				missing_arg(cmd);
+		} else if (config && !strcmp(cmd, "ip-ttl")) {
+			/* ip-ttl <minutes>: expire ip routes, 0 = never */
+			if (arg) {
+				int k = atoi(arg);
+
+				if (k < 0) {
+					invalid_arg(cmd, arg);
+					continue;
+				} else {
+					config->ip_ttl = k * 60;
+				}
+			} else
+				missing_arg(cmd);
 		} else if (config && !strcmp(cmd, "dg-mtu")) {
 			/* dg-mtu <mtu>: MTU for datagram mode routes (unused) */
 			if (arg) {
@@ -466,22 +521,40 @@ void load_config(void)
 				missing_arg(cmd);
 		} else if (!strcmp(cmd, "ip-encaps-dev")) {
 			if (arg)
-				strcpy(ip_encaps_dev, arg);
+				strncpy(set->ip_encaps_dev, arg,
+					sizeof(set->ip_encaps_dev) - 1);
 			else
 				missing_arg(cmd);
+		} else if (config && (!strcmp(cmd, "ax25-port-maxroutes") ||
+				      !strcmp(cmd, "ip-port-maxroutes"))) {
+			/* ax25-port-maxroutes <n>: entries of this port, 0 = no limit */
+			if (arg) {
+				int k = atoi(arg);
+
+				if (k < 0) {
+					invalid_arg(cmd, arg);
+					continue;
+				} else if (*cmd == 'a') {
+					config->ax25_maxroutes = k;
+				} else {
+					config->ip_maxroutes = k;
+				}
+			} else
+				missing_arg(cmd);
 		} else if (!strcmp(cmd, "ax25-maxroutes")) {
 			if (arg)
-				ax25_maxroutes = atoi(arg);
+				set->ax25_maxroutes = atoi(arg);
 			else
 				missing_arg(cmd);
 		} else if (!strcmp(cmd, "ip-maxroutes")) {
 			if (arg)
-				ip_maxroutes = atoi(arg);
+				set->ip_maxroutes = atoi(arg);
 			else
 				missing_arg(cmd);
 		} else if (!strcmp(cmd, "iproute2-table")) {
 			if (arg)
-				strcpy(iproute2_table, arg);
+				strncpy(set->iproute2_table, arg,
+					sizeof(set->iproute2_table) - 1);
 			else
 				missing_arg(cmd);
 		} else
@@ -489,24 +562,99 @@ void load_config(void)
 	}
 	fclose(fp);
 
-	load_ports();
-	load_listeners();
+	return set;
+}
+
+/*
+ * Build a complete new configuration and check it.  Returns NULL if it
+ * cannot be used; the current one is left alone in that case.
+ */
+
+static config_set *read_config(void)
+{
+	config_set *set;
+
+	set = parse_config();
+	if (set == NULL)
+		return NULL;
+
+	if (load_ports(set) < 0)
+		goto bad;
+	index_config(set);
+	if (load_listeners(set) < 0)
+		goto bad;
+
+	if (set->list == NULL) {
+		fprintf(stderr, "no configured port has an interface\n");
+		goto bad;
+	}
+	if (set->ip_maxroutes <= 0 || set->ax25_maxroutes <= 0) {
+		fprintf(stderr, "invalid maxroutes\n");
+		goto bad;
+	}
+
+	return set;
+
+bad:
+	free_config(set);
+	return NULL;
+}
+
+/*
+ * Switch to set.  Nobody keeps a config pointer from one round of the
+ * main loop to the next, so the old set is freed by reclaim_config()
+ * at the start of the next round.
+ */
+
+static config_set *retired;
+
+static void publish_config(config_set *set)
+{
+	reclaim_config();
+	retired = Configs;
+	Configs = set;
+
+	strcpy(ip_encaps_dev, set->ip_encaps_dev);
+	strcpy(iproute2_table, set->iproute2_table);
+	ip_maxroutes = set->ip_maxroutes;
+	ax25_maxroutes = set->ax25_maxroutes;
+}
+
+void reclaim_config(void)
+{
+	if (retired != NULL)
+		free_config(retired);
+	retired = NULL;
+}
+
+void load_config(void)
+{
+	config_set *set;
 
+	set = read_config();
+	if (set == NULL)
+		exit(1);
+
+	publish_config(set);
 	reload = 0;
 }
 
 void reload_config(void)
 {
-	config *cfg, *config = Config;
+	config_set *set;
 
-	while (config) {
-		cfg = config->next;
-		free(config);
-		config = cfg;
+	reload = 0;
+
+	set = read_config();
+	if (set == NULL) {
+		fprintf(stderr, "ax25rtd: reload failed, "
+			"keeping the old configuration\n");
+		return;
 	}
-	Config = NULL;
 
-	load_config();
+	publish_config(set);
+	pkt_filter();
+	rearm_timers();
 }
 
 /* commands:
@@ -516,7 +664,9 @@ void reload_config(void)
    add ip   <ip> <dev> <time> <call> <mode>		# Add an IP route & mode
    del ax25 <callsign> <dev>				# Remove an AX.25 route (from cache)
    del ip   <ip>					# Remove an IP route (from cache)
-   list [ax25|ip]					# List cache entries
+   list [ax25|ip] [<filter> ...] [json]		# List cache entries
+   ports						# Cache entries per port
+   stats						# Counters
    reload						# Reload config
    save							# Save cache
    expire <minutes>					# Expire cache entries
@@ -537,6 +687,17 @@ void reload_config(void)
 
    Note that in conflicting cases the network device name has precedence
    over the port name.
+
+   'list' takes these filters:
+
+   port <port>		entries on this port or device only
+   call <prefix>	callsigns starting with <prefix>
+   age <minutes>	entries heard in the last <minutes>
+   mode v|d		ip entries in this mode
+   count <n>		at most <n> entries, then "next <cursor>"
+   after <cursor>	continue a listing cut short by count
+
+   With 'json' every entry is one JSON object on a line of its own.
 */
 
 void interpret_command(int fd, char *buf)
@@ -546,6 +707,7 @@ void interpret_command(int fd, char *buf)
 	ax25_rt_entry *ax25rt;
 	int ndigi, ipmode, action;
 	time_t stamp;
+	list_filter filter;
 	config *config;
 	long ip;
 
@@ -589,9 +751,9 @@ void interpret_command(int fd, char *buf)
 
 			ax25rt =
 			    update_ax25_route(config, asc2ax(arg2), ndigi,
-					      digipeater, stamp);
+					      digipeater, stamp, 1);
 			if (ax25rt != NULL)
-				set_ax25_route(config, ax25rt);
+				set_ax25_route(config, ax25rt, 0);
 		} else if (!strcmp(arg, "ip")) {
 			ip = asc2ip(arg2);
 
@@ -620,7 +782,7 @@ void interpret_command(int fd, char *buf)
 					    asc2ax(arg2), stamp);
 
 			if (action & NEW_ROUTE)
-				if (set_route(config, ip))
+				if (set_route(config, ip, 0))
 					return;
 
 			if (action & NEW_ARP)
@@ -663,10 +825,52 @@ void interpret_command(int fd, char *buf)
 		if (arg == NULL)
 			return;
 
+		memset(&filter, 0, sizeof(filter));
+		filter.ipmode = -1;
+
+		while ((arg2 = get_next_arg(&p)) != NULL) {
+			if (!strcmp(arg2, "json")) {
+				filter.json = 1;
+				continue;
+			}
+
+			time = get_next_arg(&p);
+			if (time == NULL)
+				break;
+
+			if (!strcmp(arg2, "port")) {
+				filter.config = dev_get_config(time);
+				if (filter.config == NULL) {
+					ctl_write(fd, ".\n", 2);
+					return;
+				}
+			} else if (!strcmp(arg2, "call")) {
+				for (ndigi = 0; time[ndigi] &&
+				     ndigi < (int) sizeof(filter.call) - 1; ndigi++)
+					filter.call[ndigi] = toupper(time[ndigi]);
+			} else if (!strcmp(arg2, "age")) {
+				filter.age = atoi(time);
+			} else if (!strcmp(arg2, "mode")) {
+				filter.ipmode = (*time == 'v');
+			} else if (!strcmp(arg2, "count")) {
+				filter.count = atoi(time);
+			} else if (!strcmp(arg2, "after")) {
+				filter.after = 1;
+				if (!strcmp(arg, "ip"))
+					filter.after_ip = asc2ip(time);
+				else
+					filter.after_call = *asc2ax(time);
+			}
+		}
+
 		if (!strcmp(arg, "ax25"))
-			dump_ax25_routes(fd, 0);
+			list_ax25_routes(fd, &filter);
 		else if (!strcmp(arg, "ip"))
-			dump_ip_routes(fd, 0);
+			list_ip_routes(fd, &filter);
+	} else if (!strcmp(cmd, "ports")) {
+		list_ports(fd);
+	} else if (!strcmp(cmd, "stats")) {
+		list_stats(fd);
 	} else if (!strcmp(cmd, "shutdown")) {
 		save_cache();
 		daemon_shutdown(0);
@@ -674,9 +878,9 @@ void interpret_command(int fd, char *buf)
 		save_cache();
 	} else if (!strcmp(cmd, "version")) {
 		char buf[] = "ax25rtd version " VERSION "\n";
-		write(fd, buf, strlen(buf));
+		ctl_write(fd, buf, strlen(buf));
 	} else if (!strcmp(cmd, "quit")) {
-		close(fd);
+		ctl_close(fd);
 	}
 }
 
@@ -685,6 +889,9 @@ void load_cache(void)
 	FILE *fp;
 	char buf[512];
 
+	if (load_snapshot() == 0)
+		return;
+
 	fp = fopen(DATA_AX25ROUTED_AXRT_FILE, "r");
 	if (fp != NULL) {
 		while (fgets(buf, sizeof(buf), fp) != NULL)
@@ -702,16 +909,34 @@ void load_cache(void)
 		perror("open IP route cache file");
 }
 
-void save_cache(void)
+/* replace path in one step, so a crash leaves the old or the new file */
+
+static void save_text(char *path, void (*dump)(int, int))
 {
+	char tmp[256];
 	int fd;
 
-	fd = creat(DATA_AX25ROUTED_AXRT_FILE, 0664);
-	dump_ax25_routes(fd, 1);
-	close(fd);
+	sprintf(tmp, "%s.tmp", path);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		perror(tmp);
+		return;
+	}
+
+	dump(fd, 1);
 
-	fd = creat(DATA_AX25ROUTED_IPRT_FILE, 0664);
-	dump_ip_routes(fd, 1);
+	if (fsync(fd) < 0 || rename(tmp, path) < 0) {
+		perror(path);
+		unlink(tmp);
+	}
 	close(fd);
+}
+
+void save_cache(void)
+{
+	save_text(DATA_AX25ROUTED_AXRT_FILE, dump_ax25_routes);
+	save_text(DATA_AX25ROUTED_IPRT_FILE, dump_ip_routes);
 
+	/* after the text files, so it is not taken for out of date */
+	save_snapshot();
 }
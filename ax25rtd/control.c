@@ -0,0 +1,295 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+ *   02110-1301, USA.
+ *
+ */
+
+/*
+ * The control socket.
+ *
+ * Any number of clients (up to CTL_MAXCLIENTS) may be connected at
+ * once.  Client sockets are non-blocking; commands are read a line at a
+ * time and their replies are collected in a per-client buffer that is
+ * written out as the socket drains.  While a client has more than
+ * CTL_HIWAT bytes of output pending no further commands are read from
+ * it, so a slow or stalled reader holds nothing up but itself.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <netax25/ax25.h>
+
+#include "../pathnames.h"
+#include "ax25rtd.h"
+
+#define CTL_MAXCLIENTS	16
+#define CTL_LINE	512
+#define CTL_HIWAT	16384
+
+struct ctl_client {
+	int fd;			/* -1 if the slot is free */
+	int closing;		/* close once the output is out */
+	char in[CTL_LINE];
+	int inlen;
+	char *out;
+	size_t outoff, outlen, outsize;
+};
+
+static struct ctl_client clients[CTL_MAXCLIENTS];
+static int ctl_sock = -1;
+
+int ctl_open(void)
+{
+	struct sockaddr_un addr;
+	socklen_t len;
+	int k;
+
+	for (k = 0; k < CTL_MAXCLIENTS; k++)
+		clients[k].fd = -1;
+
+	ctl_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (ctl_sock < 0)
+		return -1;
+
+	unlink(DATA_AX25ROUTED_CTL_SOCK);
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, DATA_AX25ROUTED_CTL_SOCK);
+	len = sizeof(addr.sun_family) + strlen(DATA_AX25ROUTED_CTL_SOCK);
+
+	if (bind(ctl_sock, (struct sockaddr *) &addr, len) < 0)
+		return -1;
+
+	chmod(DATA_AX25ROUTED_CTL_SOCK, 0600);
+	fcntl(ctl_sock, F_SETFL, fcntl(ctl_sock, F_GETFL) | O_NONBLOCK);
+
+	return listen(ctl_sock, CTL_MAXCLIENTS);
+}
+
+static struct ctl_client *ctl_client(int fd)
+{
+	int k;
+
+	for (k = 0; k < CTL_MAXCLIENTS; k++)
+		if (clients[k].fd == fd && fd >= 0)
+			return &clients[k];
+	return NULL;
+}
+
+static void ctl_drop(struct ctl_client *c)
+{
+	close(c->fd);
+	free(c->out);
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+}
+
+/*
+ * Output for fd: queued if it is a control client, written straight
+ * through otherwise (the cache files, stderr).
+ */
+
+void ctl_write(int fd, const char *buf, int len)
+{
+	struct ctl_client *c;
+	size_t size;
+	char *p;
+
+	c = ctl_client(fd);
+	if (c == NULL) {
+		write(fd, buf, len);
+		return;
+	}
+
+	if (c->outoff == c->outlen)
+		c->outoff = c->outlen = 0;
+
+	if (c->outlen + len > c->outsize) {
+		size = c->outsize ? c->outsize : 4096;
+		while (size < c->outlen + len)
+			size *= 2;
+		p = realloc(c->out, size);
+		if (p == NULL) {
+			c->closing = 1;
+			return;
+		}
+		c->out = p;
+		c->outsize = size;
+	}
+
+	memcpy(c->out + c->outlen, buf, len);
+	c->outlen += len;
+}
+
+void ctl_close(int fd)
+{
+	struct ctl_client *c;
+
+	c = ctl_client(fd);
+	if (c != NULL)
+		c->closing = 1;
+	else
+		close(fd);
+}
+
+static void ctl_accept(void)
+{
+	int fd, k;
+
+	for (;;) {
+		fd = accept(ctl_sock, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				perror("accept Control");
+			return;
+		}
+
+		for (k = 0; k < CTL_MAXCLIENTS; k++)
+			if (clients[k].fd < 0)
+				break;
+
+		if (k == CTL_MAXCLIENTS) {
+			close(fd);
+			continue;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		clients[k].fd = fd;
+	}
+}
+
+/* run the complete lines we have, as long as the output keeps up */
+
+static void ctl_commands(struct ctl_client *c)
+{
+	char line[CTL_LINE];
+	char *nl;
+	int len;
+
+	while (!c->closing && c->outlen - c->outoff < CTL_HIWAT) {
+		nl = memchr(c->in, '\n', c->inlen);
+		if (nl == NULL)
+			break;
+
+		len = nl - c->in + 1;
+		memcpy(line, c->in, len);
+		line[len] = '\0';
+		c->inlen -= len;
+		memmove(c->in, c->in + len, c->inlen);
+
+		interpret_command(c->fd, line);
+	}
+}
+
+static void ctl_read(struct ctl_client *c)
+{
+	int n;
+
+	n = read(c->fd, c->in + c->inlen, sizeof(c->in) - 1 - c->inlen);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n <= 0) {
+		ctl_drop(c);
+		return;
+	}
+
+	c->inlen += n;
+	ctl_commands(c);
+
+	/* a line that does not fit is not a command of ours */
+	if (c->inlen == sizeof(c->in) - 1)
+		ctl_drop(c);
+}
+
+static void ctl_flush(struct ctl_client *c)
+{
+	ssize_t n;
+
+	while (c->outoff < c->outlen) {
+		n = write(c->fd, c->out + c->outoff, c->outlen - c->outoff);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return;
+			ctl_drop(c);
+			return;
+		}
+		c->outoff += n;
+	}
+
+	/* the buffer of a big listing is not kept around */
+	if (c->outsize > CTL_HIWAT) {
+		free(c->out);
+		c->out = NULL;
+		c->outsize = 0;
+	}
+	c->outoff = c->outlen = 0;
+
+	ctl_commands(c);
+	if (c->closing && c->outoff == c->outlen)
+		ctl_drop(c);
+}
+
+void ctl_fds(fd_set *read_fds, fd_set *write_fds, int *fd_max)
+{
+	struct ctl_client *c;
+	int k;
+
+	FD_SET(ctl_sock, read_fds);
+	if (ctl_sock > *fd_max)
+		*fd_max = ctl_sock;
+
+	for (k = 0; k < CTL_MAXCLIENTS; k++) {
+		c = &clients[k];
+		if (c->fd < 0)
+			continue;
+		if (!c->closing && c->outlen - c->outoff < CTL_HIWAT)
+			FD_SET(c->fd, read_fds);
+		if (c->outoff < c->outlen || c->closing)
+			FD_SET(c->fd, write_fds);
+		if (c->fd > *fd_max)
+			*fd_max = c->fd;
+	}
+}
+
+void ctl_process(fd_set *read_fds, fd_set *write_fds)
+{
+	struct ctl_client *c;
+	int k;
+
+	for (k = 0; k < CTL_MAXCLIENTS; k++) {
+		c = &clients[k];
+		if (c->fd >= 0 && FD_ISSET(c->fd, read_fds))
+			ctl_read(c);
+		if (c->fd >= 0 && FD_ISSET(c->fd, write_fds))
+			ctl_flush(c);
+	}
+
+	if (FD_ISSET(ctl_sock, read_fds))
+		ctl_accept();
+}
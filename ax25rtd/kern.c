@@ -0,0 +1,480 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+ *   02110-1301, USA.
+ *
+ */
+
+/*
+ * Queued kernel changes.
+ *
+ * set_route(), set_arp() and friends do not touch the kernel any more.
+ * They record an intent: what one route, ARP entry or IP mode on one
+ * port should become.  A newer intent for the same target replaces one
+ * that is still waiting, so a burst of frames from one station costs a
+ * single kernel change.  The main loop calls kern_apply() to carry out
+ * a batch of them between reads from the packet socket.
+ *
+ * A change that fails right away is tried again a few times, a bit
+ * later each time.  When it still fails, an IP route or ARP entry is
+ * marked invalid, as it used to be on the first failure.  Netlink
+ * requests fail later, in nl_error().
+ *
+ * The time a change takes is kept per kind of change: for ioctls and
+ * external commands the call itself, for netlink requests the time
+ * until the kernel answers.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netax25/ax25.h>
+
+#include "ax25rtd.h"
+
+#define KERN_HASHSIZE	1024	/* must be a power of two */
+#define KERN_BATCH	64	/* changes per kern_apply() */
+#define KERN_RETRIES	3
+
+struct kern_op {
+	struct kern_op *next, *prev;	/* ready or waiting list */
+	struct kern_op *hnext;		/* hash chain */
+	int op;				/* KOP_* */
+	char dev[14];
+	ax25_address call;
+	unsigned long ip;
+	int ipmode;
+	int ndigi;
+	ax25_address digipeater[AX25_MAX_DIGIS];
+	int tries;
+	time_t retry;			/* not before, on the waiting list */
+	int fresh;			/* an add the kernel has never seen */
+};
+
+struct kern_list {
+	struct kern_op *head, *tail;
+};
+
+static struct kern_list ready, waiting;
+static struct kern_op *kern_hash[KERN_HASHSIZE];
+
+struct kern_stat kern_stats[KOP_MAX];
+
+/* add and delete of the same thing replace each other */
+
+static const int kop_target[KOP_MAX] = {
+	[KOP_AX25_ADD] = 0, [KOP_AX25_DEL] = 0,
+	[KOP_IP_ADD] = 1, [KOP_IP_DEL] = 1,
+	[KOP_ARP] = 2,
+	[KOP_IPMODE] = 3,
+};
+
+static inline int kop_by_ip(int op)
+{
+	return kop_target[op] == 1 || kop_target[op] == 2;
+}
+
+static unsigned int kern_hashfn(int op, const char *dev, ax25_address * call,
+				unsigned long ip)
+{
+	unsigned int h = kop_target[op];
+	int k;
+
+	if (kop_by_ip(op))
+		h = h * 31 + (ip ^ (ip >> 16));
+	else
+		for (k = 0; k < AXLEN; k++)
+			h = h * 31 + (unsigned char) call->ax25_call[k];
+
+	for (; *dev; dev++)
+		h = h * 31 + (unsigned char) *dev;
+
+	return h & (KERN_HASHSIZE - 1);
+}
+
+static struct kern_op **kern_find(int op, const char *dev,
+				  ax25_address * call, unsigned long ip)
+{
+	struct kern_op **pp;
+
+	pp = &kern_hash[kern_hashfn(op, dev, call, ip)];
+	for (; *pp; pp = &(*pp)->hnext) {
+		if (kop_target[(*pp)->op] != kop_target[op] ||
+		    strcmp((*pp)->dev, dev))
+			continue;
+		if (kop_by_ip(op) ? (*pp)->ip == ip :
+		    !memcmp(&(*pp)->call, call, AXLEN))
+			break;
+	}
+
+	return pp;
+}
+
+static void list_add(struct kern_list *l, struct kern_op *q)
+{
+	q->next = NULL;
+	q->prev = l->tail;
+	if (l->tail)
+		l->tail->next = q;
+	else
+		l->head = q;
+	l->tail = q;
+}
+
+static void list_del(struct kern_list *l, struct kern_op *q)
+{
+	if (q->prev)
+		q->prev->next = q->next;
+	else
+		l->head = q->next;
+	if (q->next)
+		q->next->prev = q->prev;
+	else
+		l->tail = q->prev;
+}
+
+/* forget an operation already taken off its list */
+
+static void kern_free(struct kern_op *q)
+{
+	struct kern_op **pp;
+
+	pp = kern_find(q->op, q->dev, &q->call, q->ip);
+	if (*pp == q)
+		*pp = q->hnext;
+	free(q);
+}
+
+/*
+ * The queued operation for this target, or a new one.  fresh: an add
+ * of something the kernel does not have yet.
+ */
+
+static struct kern_op *kern_get(int op, char *dev, ax25_address * call,
+				unsigned long ip, int fresh)
+{
+	struct kern_op **pp, *q;
+
+	pp = kern_find(op, dev, call, ip);
+	q = *pp;
+
+	if (q != NULL) {
+		kern_stats[op].merged++;
+		if (q->retry) {
+			list_del(&waiting, q);
+			list_add(&ready, q);
+		}
+		/* an add over a pending delete: the kernel has the old one */
+		if (q->op != op)
+			q->fresh = 0;
+	} else {
+		q = calloc(1, sizeof(*q));
+		if (q == NULL) {
+			perror("ax25rtd: kern_get");
+			return NULL;
+		}
+		strcpy(q->dev, dev);
+		if (call != NULL)
+			q->call = *call;
+		q->ip = ip;
+		q->hnext = NULL;
+		*pp = q;
+		list_add(&ready, q);
+		kern_stats[op].queued++;
+		q->fresh = fresh;
+	}
+
+	q->op = op;
+	q->tries = 0;
+	q->retry = 0;
+	return q;
+}
+
+/*
+ * A delete of something only a pending add would have created: drop
+ * both rather than ask the kernel to delete what it never had.
+ */
+
+static int kern_cancel(int op, char *dev, ax25_address * call,
+		       unsigned long ip)
+{
+	struct kern_op *q, *arp;
+
+	q = *kern_find(op, dev, call, ip);
+	if (q == NULL || q->op == op || !q->fresh)
+		return 0;
+
+	kern_stats[op].merged++;
+	list_del(q->retry ? &waiting : &ready, q);
+	kern_free(q);
+
+	/* no ARP entry without the route */
+	if (op == KOP_IP_DEL) {
+		arp = *kern_find(KOP_ARP, dev, NULL, ip);
+		if (arp != NULL) {
+			list_del(arp->retry ? &waiting : &ready, arp);
+			kern_free(arp);
+		}
+	}
+
+	return 1;
+}
+
+int set_ax25_route(config * config, ax25_rt_entry * rt, int fresh)
+{
+	struct kern_op *q;
+
+	if (!config->ax25_add_route)
+		return 0;
+
+	q = kern_get(KOP_AX25_ADD, config->dev, &rt->call, 0, fresh);
+	if (q == NULL)
+		return 1;
+
+	q->ndigi = rt->ndigi;
+	memcpy(q->digipeater, rt->digipeater, rt->ndigi * AXLEN);
+	return 0;
+}
+
+int del_kernel_ax25_route(char *dev, ax25_address * call)
+{
+	config *config;
+
+	config = dev_get_config(dev);
+	if (config == NULL || !config->ax25_add_route)
+		return 0;
+
+	if (kern_cancel(KOP_AX25_DEL, dev, call, 0))
+		return 0;
+
+	return kern_get(KOP_AX25_DEL, dev, call, 0, 0) == NULL;
+}
+
+int set_route(config * config, long ip, int fresh)
+{
+	/* even without ip-add-route, other host routes are cleared */
+	return kern_get(KOP_IP_ADD, config->dev, NULL, ip, fresh) == NULL;
+}
+
+int del_kernel_ip_route(char *dev, long ip)
+{
+	config *config;
+
+	config = dev_get_config(dev);
+	if (config == NULL || !config->ip_add_route)
+		return 0;
+
+	if (kern_cancel(KOP_IP_DEL, dev, NULL, ip))
+		return 0;
+
+	return kern_get(KOP_IP_DEL, dev, NULL, ip, 0) == NULL;
+}
+
+int set_arp(config * config, long ip, ax25_address * call)
+{
+	struct kern_op *q;
+
+	if (!config->ip_add_arp)
+		return 0;
+
+	q = kern_get(KOP_ARP, config->dev, NULL, ip, 0);
+	if (q == NULL)
+		return 1;
+
+	q->call = *call;
+	return 0;
+}
+
+int set_ipmode(config * config, ax25_address * call, int ipmode)
+{
+	struct kern_op *q;
+
+	if (!config->ip_adjust_mode)
+		return 0;
+
+	q = kern_get(KOP_IPMODE, config->dev, call, 0, 0);
+	if (q == NULL)
+		return 1;
+
+	q->ipmode = ipmode;
+	return 0;
+}
+
+/* the kernel is done with a change of kind op issued at since */
+
+void kern_latency(int op, struct timespec *since)
+{
+	struct timespec now;
+	unsigned long usec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = (now.tv_sec - since->tv_sec) * 1000000L +
+	    (now.tv_nsec - since->tv_nsec) / 1000;
+
+	kern_stats[op].timed++;
+	kern_stats[op].usec += usec;
+	if (usec > kern_stats[op].usec_max)
+		kern_stats[op].usec_max = usec;
+}
+
+static int kern_call(struct kern_op *q, config * config)
+{
+	switch (q->op) {
+	case KOP_AX25_ADD:
+		return kern_ax25_route(config, &q->call, q->ndigi,
+				       q->digipeater);
+	case KOP_AX25_DEL:
+		return kern_ax25_del(config, &q->call);
+	case KOP_IP_ADD:
+		return kern_route(config, q->ip);
+	case KOP_IP_DEL:
+		return kern_ip_del(config, q->ip);
+	case KOP_ARP:
+		return kern_arp(config, q->ip, &q->call);
+	case KOP_IPMODE:
+		return kern_ipmode(config, &q->call, q->ipmode);
+	}
+
+	return 0;
+}
+
+static int kern_do(struct kern_op *q)
+{
+	struct timespec t0;
+	unsigned long queued = nl_queued;
+	config *config;
+	int rc;
+
+	/* the port may have gone with a reload */
+	config = dev_get_config(q->dev);
+	if (config == NULL)
+		return 0;
+
+	/* a replay only counts what would have been done */
+	if (replaying)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	rc = kern_call(q, config);
+
+	/* netlink requests are timed in nl_error() */
+	if (nl_queued == queued)
+		kern_latency(q->op, &t0);
+
+	return rc;
+}
+
+/* q failed for good; rc > 0 if it has not been dealt with yet */
+
+static void kern_fail(struct kern_op *q, int rc)
+{
+	struct kern_op *arp;
+
+	kern_stats[q->op].failed++;
+
+	if (q->op != KOP_IP_ADD && q->op != KOP_ARP)
+		return;
+
+	if (rc > 0)
+		invalidate_ip_route(q->ip);
+
+	/* no ARP entry without the route */
+	if (q->op == KOP_IP_ADD) {
+		arp = *kern_find(KOP_ARP, q->dev, NULL, q->ip);
+		if (arp != NULL) {
+			list_del(arp->retry ? &waiting : &ready, arp);
+			kern_free(arp);
+		}
+	}
+}
+
+/*
+ * Apply up to KERN_BATCH queued changes.  Returns the number of seconds
+ * until the next one is due, 0 if some are ready now, or -1 if the queue
+ * is empty.
+ */
+
+int kern_apply(void)
+{
+	struct kern_op *q, *next;
+	time_t now, due = 0;
+	int n, rc;
+
+	now = time(NULL);
+
+	for (q = waiting.head; q; q = next) {
+		next = q->next;
+		if (q->retry <= now) {
+			list_del(&waiting, q);
+			q->retry = 0;
+			list_add(&ready, q);
+		}
+	}
+
+	for (n = 0; n < KERN_BATCH && (q = ready.head) != NULL; n++) {
+		list_del(&ready, q);
+
+		rc = kern_do(q);
+		if (rc == 0) {
+			kern_stats[q->op].applied++;
+		} else if (rc > 0 && q->tries < KERN_RETRIES) {
+			kern_stats[q->op].retried++;
+			q->tries++;
+			q->retry = now + (1 << q->tries);
+			list_add(&waiting, q);
+			continue;
+		} else {
+			kern_fail(q, rc);
+		}
+
+		kern_free(q);
+	}
+
+	if (ready.head != NULL)
+		return 0;
+
+	for (q = waiting.head; q; q = q->next)
+		if (due == 0 || q->retry < due)
+			due = q->retry;
+
+	return due ? due - now : -1;
+}
+
+/* apply everything once, without retries, before we exit */
+
+void kern_flush(void)
+{
+	struct kern_op *q;
+
+	while ((q = waiting.head) != NULL) {
+		list_del(&waiting, q);
+		q->retry = 0;
+		list_add(&ready, q);
+	}
+
+	while ((q = ready.head) != NULL) {
+		list_del(&ready, q);
+		if (kern_do(q) == 0)
+			kern_stats[q->op].applied++;
+		else
+			kern_stats[q->op].failed++;
+		kern_free(q);
+	}
+}
@@ -18,9 +18,6 @@
  *
  */
 
- /* TODO: Should add partial path to ax25_route if we are one of the
-  *       digipeaters.
-  */
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -38,6 +35,11 @@
 #include <net/route.h>
 #include <net/if.h>
 #include <net/if_arp.h>
+#ifdef __GLIBC__
+#include <net/ethernet.h>
+#else
+#include <linux/if_ether.h>
+#endif
 
 #include <netax25/ax25.h>
 
@@ -46,13 +48,64 @@
 
 #include <stdlib.h>
 
-/* FIXME */
-static unsigned long get_from_arp(unsigned char *data, int size)
+struct frame_stat frame_stats;
+
+/*
+ * An AX.25 ARP request or reply is laid out as in RFC 826, with 7 byte
+ * hardware addresses:
+ *
+ *	hrd(2) pro(2) hln(1) pln(1) op(2) sha(7) spa(4) tha(7) tpa(4)
+ *
+ * Linux sends pro as the AX.25 PID for IP, others may use the Ethernet
+ * type.  The sender's protocol address is only taken if the sender's
+ * hardware address is the source of the frame.
+ */
+
+#define ARP_LEN		(8 + 2 * (AXLEN + 4))
+#define ARP_SHA		8
+#define ARP_SPA		(ARP_SHA + AXLEN)
+
+static unsigned long get_from_arp(unsigned char *data, int size,
+				  ax25_address * call)
 {
-	if (size < 16)
+	unsigned long adr;
+	unsigned char *spa;
+	int pro, op;
+
+	if (size < ARP_LEN)
+		return 0;
+
+	if (((data[0] << 8) | data[1]) != ARPHRD_AX25)
 		return 0;
 
-	return ntohl(0);
+	pro = (data[2] << 8) | data[3];
+	if (pro != PID_IP && pro != ETH_P_IP)
+		return 0;
+
+	if (data[4] != AXLEN || data[5] != 4)
+		return 0;
+
+	op = (data[6] << 8) | data[7];
+	if (op != ARPOP_REQUEST && op != ARPOP_REPLY)
+		return 0;
+
+	if (memcmp(data + ARP_SHA, call, ALEN)
+	    || (data[ARP_SHA + ALEN] & 0x1e) !=
+	    (unsigned char) call->ax25_call[ALEN])
+		return 0;
+
+	spa = data + ARP_SPA;
+
+	/* no probes, broadcasts or multicast groups */
+	if (spa[0] == 0 || spa[0] >= 224)
+		return 0;
+
+	adr = spa[0] << 24;	/* NETWORK byte order */
+	adr += spa[1] << 16;
+	adr += spa[2] << 8;
+	adr += spa[3];
+
+	return ntohl(adr);	/* HOST byte order */
 }
 
 static unsigned long get_from_ip(unsigned char *data, int size)
@@ -126,7 +179,27 @@ static inline void invert_digipeater_path(ax25_address * digipeater,
 	}
 }
 
-int set_arp(config * config, long ip, ax25_address * call)
+/*
+ * Without netlink, routes and ARP entries are set with ioctls.  The
+ * sockets for those are opened once and kept.
+ *
+ * The kern_*() functions below change the kernel right away; they are
+ * called by kern_apply() for the changes queued in kern.c.  They return
+ * 0 if done, a positive value if the change failed and may be tried
+ * again, and -1 if it must not be made at all.
+ */
+
+static int inet_fd = -1;
+static int ax25_fd = -1;
+
+static int ioctl_sock(int *fd, int family, int type)
+{
+	if (*fd < 0)
+		*fd = socket(family, type, 0);
+	return *fd;
+}
+
+int kern_arp(config * config, long ip, ax25_address * call)
 {
 	struct sockaddr_in *isa;
 	struct sockaddr_ax25 *asa;
@@ -136,7 +209,10 @@ int set_arp(config * config, long ip, ax25_address * call)
 	if (!config->ip_add_arp)
 		return 0;
 
-	fds = socket(AF_INET, SOCK_DGRAM, 0);
+	if (nl_sock >= 0 && config->ifindex)
+		return nl_neigh(ip, config, call);
+
+	fds = ioctl_sock(&inet_fd, AF_INET, SOCK_DGRAM);
 
 	memset(&arp, 0, sizeof(arp));
 
@@ -155,17 +231,14 @@ int set_arp(config * config, long ip, ax25_address * call)
 	strcpy(arp.arp_dev, config->dev);
 
 	if (ioctl(fds, SIOCSARP, &arp) < 0) {
-		invalidate_ip_route(ip);
 		perror("routspy: SIOCSARP");
-		close(fds);
 		return 1;
 	}
-	close(fds);
 	return 0;
 }
 
 /* dl9sau: use iproute2 for advanced routing.
- * Anyone likes to implement this directly, without system()?
+ * Only used if there is no netlink socket.
  */
 #define	RT_DEL		0
 #define	RT_ADD		1
@@ -185,20 +258,45 @@ static int iproute2(long ip, char *dev, int what)
 	sprintf(buffer, "/sbin/ip route %s %s dev %s table %s proto ax25rtd", (what ? "add" : "del"), ipa, dev, iproute2_table);
 
 	ret = system(buffer);
-	return ret;
+	return ret != 0;
 }
 
-int set_route(config * config, long ip)
+/*
+ * Is there a host route to ip already?  If it is on one of our ports,
+ * remove it; if it is on some other interface, leave it alone.
+ * Returns 1 in the latter case.  A route on the port itself will be
+ * replaced by the new one anyway.
+ */
+static int clear_host_routes(config * cfg, long ip)
+{
+	int ifindex[8];
+	int k, n;
+	config *config;
+
+	n = nl_host_routes(ip, ifindex, 8);
+	for (k = 0; k < n; k++) {
+		config = ifindex_get_config(ifindex[k]);
+		if (config == NULL) {
+			invalidate_ip_route(ip);
+			return 1;
+		}
+		if (config != cfg)
+			kern_ip_del(config, ip);
+	}
+
+	return 0;
+}
+
+/* the same without netlink, the hard way */
+static int clear_host_routes_proc(long ip)
 {
-	struct rtentry rt;
-	struct sockaddr_in *isa;
 	char origdev[16], buf[1024];
 /* modif f5lct */
 	long gwr;
 /* fin modif f5lct */
 	long ipr;
-	int fds;
 	FILE *fp;
+	config *config;
 
 	fp = fopen(PROC_IP_ROUTE_FILE, "r");
 	if (fp == NULL) {
@@ -214,25 +312,42 @@ int set_route(config * config, long ip)
 		if (ipr == ip && gwr == 00000000)
 /* fin modif f5lct */
 		{
-			if (dev_get_config(origdev) == NULL) {
+			if ((config = dev_get_config(origdev)) == NULL) {
 				invalidate_ip_route(ip);
 				fclose(fp);
 				return 1;
 			} else {
-				del_kernel_ip_route(origdev, ip);
+				kern_ip_del(config, ip);
 			}
 		}
 
 	}
 	fclose(fp);
+	return 0;
+}
+
+int kern_route(config * config, long ip)
+{
+	struct rtentry rt;
+	struct sockaddr_in *isa;
+	int fds;
+
+	if (nl_sock >= 0) {
+		if (clear_host_routes(config, ip))
+			return -1;
+	} else if (clear_host_routes_proc(ip))
+		return -1;
 
 	if (!config->ip_add_route)
 		return 0;
 
+	if (nl_sock >= 0 && config->ifindex)
+		return nl_route(RT_ADD, ip, config);
+
 	if (*iproute2_table)
 		return iproute2(ip, config->dev, RT_ADD);
 
-	fds = socket(AF_INET, SOCK_DGRAM, 0);
+	fds = ioctl_sock(&inet_fd, AF_INET, SOCK_DGRAM);
 
 	memset(&rt, 0, sizeof(rt));
 
@@ -254,31 +369,29 @@ int set_route(config * config, long ip)
 	isa->sin_addr.s_addr = 0xffffffff;
 
 	if (ioctl(fds, SIOCADDRT, &rt) < 0) {
-		invalidate_ip_route(ip);
 		perror("ax25rtd: IP SIOCADDRT");
-		close(fds);
 		return 1;
 	}
-	close(fds);
 
 	return 0;
 }
 
-int del_kernel_ip_route(char *dev, long ip)
+int kern_ip_del(config * config, long ip)
 {
 	int fds;
 	struct rtentry rt;
 	struct sockaddr_in *isa;
-	config *config;
 
-	config = dev_get_config(dev);
-	if (config == NULL || !config->ip_add_route)
+	if (!config->ip_add_route)
 		return 0;
 
+	if (nl_sock >= 0 && config->ifindex)
+		return nl_route(RT_DEL, ip, config);
+
 	if (*iproute2_table)
-		return iproute2(ip, dev, RT_DEL);
+		return iproute2(ip, config->dev, RT_DEL);
 
-	fds = socket(AF_INET, SOCK_DGRAM, 0);
+	fds = ioctl_sock(&inet_fd, AF_INET, SOCK_DGRAM);
 
 	memset(&rt, 0, sizeof(struct rtentry));
 
@@ -288,19 +401,18 @@ int del_kernel_ip_route(char *dev, long ip)
 	isa->sin_addr.s_addr = ip;
 
 	rt.rt_flags = RTF_UP | RTF_HOST;
-	rt.rt_dev = dev;
+	rt.rt_dev = config->dev;
 
 	if (ioctl(fds, SIOCDELRT, &rt) < 0) {
 		perror("ax25rtd: IP SIOCDELRT");
-		close(fds);
 		return 1;
 	}
-	close(fds);
 
 	return 0;
 }
 
-int set_ax25_route(config * config, ax25_rt_entry * rt)
+int kern_ax25_route(config * config, ax25_address * call, int ndigi,
+		    ax25_address * digi)
 {
 	struct ax25_routes_struct ax25_route;
 	int fds, k;
@@ -309,50 +421,44 @@ int set_ax25_route(config * config, ax25_rt_entry * rt)
 		return 0;
 
 	ax25_route.port_addr = config->mycalls[0];
-	ax25_route.dest_addr = rt->call;
-	ax25_route.digi_count = rt->ndigi;
+	ax25_route.dest_addr = *call;
+	ax25_route.digi_count = ndigi;
 
-	for (k = 0; k < rt->ndigi; k++)
-		ax25_route.digi_addr[k] = rt->digipeater[k];
+	for (k = 0; k < ndigi; k++)
+		ax25_route.digi_addr[k] = digi[k];
 
-	fds = socket(AF_AX25, SOCK_SEQPACKET, 0);
+	fds = ioctl_sock(&ax25_fd, AF_AX25, SOCK_SEQPACKET);
 
 	if (ioctl(fds, SIOCADDRT, &ax25_route) < 0) {
 		perror("ax25rtd: AX.25 SIOCADDRT");
-		close(fds);
 		return 1;
 	}
 
-	close(fds);
 	return 0;
 }
 
-int del_kernel_ax25_route(char *dev, ax25_address * call)
+int kern_ax25_del(config * config, ax25_address * call)
 {
 	struct ax25_routes_struct ax25_route;
 	int fds;
-	config *config;
 
-	config = dev_get_config(dev);
-	if (config == NULL || !config->ax25_add_route)
+	if (!config->ax25_add_route)
 		return 0;
 
 	ax25_route.port_addr = config->mycalls[0];
 	ax25_route.dest_addr = *call;
 
-	fds = socket(AF_AX25, SOCK_SEQPACKET, 0);
+	fds = ioctl_sock(&ax25_fd, AF_AX25, SOCK_SEQPACKET);
 
 	if (ioctl(fds, SIOCDELRT, &ax25_route) < 0) {
 		perror("ax25rtd: AX.25 SIOCDELRT");
-		close(fds);
 		return 1;
 	}
 
-	close(fds);
 	return 0;
 }
 
-int set_ipmode(config * config, ax25_address * call, int ipmode)
+int kern_ipmode(config * config, ax25_address * call, int ipmode)
 {
 	struct ax25_route_opt_struct ax25_opt;
 	int fds;
@@ -365,75 +471,60 @@ int set_ipmode(config * config, ax25_address * call, int ipmode)
 	ax25_opt.cmd = AX25_SET_RT_IPMODE;
 	ax25_opt.arg = ipmode ? 'V' : 'D';
 
-	fds = socket(AF_AX25, SOCK_SEQPACKET, 0);
+	fds = ioctl_sock(&ax25_fd, AF_AX25, SOCK_SEQPACKET);
 
 	if (ioctl(fds, SIOCAX25OPTRT, &ax25_opt) < 0) {
 		perror("ax25rtd: SIOCAX25OPTRT");
-		close(fds);
 		return 1;
 	}
 
-	close(fds);
 	return 0;
 
 }
 
 /* Yes, the code *IS* ugly... */
 
+/*
+ * Learn from one frame heard on the port described by config.  buf
+ * holds the frame as the packet socket delivers it, KISS byte first.
+ */
+
 #define SKIP(o) {data+=(o); size-=(o);}
-void ax25_receive(int sock)
+void ax25_frame(config * config, unsigned char *buf, int size, time_t stamp)
 {
-	unsigned char buf[1500];
 	unsigned char *data;
 	unsigned long ip;
-	struct sockaddr sa;
 	ax25_address srccall, destcall, digipeater[AX25_MAX_DIGIS];
 	char extseq = 0;
-	int size, action, ipmode, ctl, pid, ndigi, kdigi, mine;
-	time_t stamp;
-	config *config;
+	int action, ipmode, ctl, pid, ndigi, kdigi, mine, via_me;
 	ax25_rt_entry *ax25rt;
-	socklen_t asize;
-
-	asize = sizeof(sa);
-	size = recvfrom(sock, buf, sizeof(buf), 0, &sa, &asize);
-	if (size < 0) {
-		perror("recvfrom");
-		save_cache();
-		daemon_shutdown(1);
-	}
 
-	stamp = time(NULL);
 	ip = 0;
 	pid = ctl = 0;
 
-	config = dev_get_config(sa.sa_data);
-
-	if (config == NULL)
-		return;
-
 	data = buf;
+	frame_stats.frames++;
 
 	/*
 	 * KISS data?
 	 */
 
 	if ((*data & 0x0f) != 0)
-		return;
+		goto bad_frame;
 
 	SKIP(1);
 
 	/* valid frame? */
 
 	if (size < (2 * AXLEN + 1))
-		return;
+		goto bad_frame;
 
 	/*
 	 * Get destination callsign
 	 */
 
 	if (check_ax25_addr(data))
-		return;
+		goto bad_addr;
 
 	memcpy(&destcall, data, AXLEN);
 	destcall.ax25_call[6] &= 0x1e;
@@ -446,7 +537,7 @@ void ax25_receive(int sock)
 	 */
 
 	if (check_ax25_addr(data))
-		return;
+		goto bad_addr;
 
 	memcpy(&srccall, data, AXLEN);
 	srccall.ax25_call[6] &= 0x1e;
@@ -465,20 +556,19 @@ void ax25_receive(int sock)
 	ndigi = 0;
 	while (((*data) & HDLCAEB) != HDLCAEB) {
 		SKIP(1);
-		if (size <= 0 || check_ax25_addr(data))
-			return;
+		if (size <= 0)
+			goto bad_frame;
+		if (check_ax25_addr(data) || ndigi == AX25_MAX_DIGIS)
+			goto bad_addr;
 
-		if (ndigi < AX25_MAX_DIGIS)
-			memcpy(&digipeater[ndigi++], data, AXLEN);
-		else
-			return;
+		memcpy(&digipeater[ndigi++], data, AXLEN);
 
 		SKIP(ALEN);
 	}
 
 	SKIP(1);
 	if (size <= 0)
-		return;
+		goto bad_frame;
 
 	/*
 	 * Get type of frame
@@ -499,7 +589,7 @@ void ax25_receive(int sock)
 	if (ctl == LAPB_I || ctl == LAPB_UI) {
 		SKIP(extseq ? 2 : 1);
 		if (size <= 0)
-			return;
+			goto bad_frame;
 
 		/* Get PID */
 
@@ -508,29 +598,44 @@ void ax25_receive(int sock)
 		if (pid == PID_SEGMENT) {
 			SKIP(1);
 			if (size <= 0)
-				return;
+				goto bad_frame;
 			pid = 0;
 
 			if (*data && SEG_FIRST) {
 				pid = *data;
 				SKIP(1);
 				if (size <= 0)
-					return;
+					goto bad_frame;
 			}
 		}
 	}
 
 	/*
-	 * See if it is fully digipeated (TODO: or if we are the next digipeater)
+	 * See if it is fully digipeated, or if we are the next digipeater.
+	 * If we are in the path, only the digipeaters before us lead back
+	 * to the sender.
 	 */
 
+	via_me = 0;
 	for (kdigi = 0; kdigi < ndigi; kdigi++) {
 		if ((digipeater[kdigi].ax25_call[6] & AX25_REPEATED) !=
-		    AX25_REPEATED)
-			return;
+		    AX25_REPEATED) {
+			digipeater[kdigi].ax25_call[6] &= 0x1e;
+			if (!call_is_mycall(config, &digipeater[kdigi])) {
+				frame_stats.not_digipeated++;
+				return;
+			}
+			via_me = 1;
+			break;
+		}
 
 		digipeater[kdigi].ax25_call[6] &= 0x1e;
+		if (call_is_mycall(config, &digipeater[kdigi])) {
+			via_me = 1;
+			break;
+		}
 	}
+	ndigi = kdigi;
 
 	invert_digipeater_path(digipeater, ndigi);
 
@@ -538,8 +643,9 @@ void ax25_receive(int sock)
 	 * Are we allowed to add it to our routing table?
 	 */
 
-	if (mine || !config->ax25_for_me) {
-		if (!mine && ndigi == 0 && config->ax25_add_default) {
+	if (mine || via_me || !config->ax25_for_me) {
+		if (!mine && !via_me && ndigi == 0
+		    && config->ax25_add_default) {
 			ndigi =
 			    config->ax25_default_path.fsa_ax25.
 			    sax25_ndigis;
@@ -560,10 +666,10 @@ void ax25_receive(int sock)
 
 		ax25rt =
 		    update_ax25_route(config, &srccall, ndigi, digipeater,
-				      stamp);
+				      stamp, 0);
 
 		if (ax25rt != NULL)
-			set_ax25_route(config, ax25rt);
+			set_ax25_route(config, ax25rt, ax25rt->cnt == 1);
 	}
 
 	/*
@@ -574,7 +680,7 @@ void ax25_receive(int sock)
 	case PID_ARP:
 		SKIP(1);
 		if (size > 0)
-			ip = get_from_arp(data, size);
+			ip = get_from_arp(data, size, &srccall);
 		break;
 	case PID_IP:
 		if (!mine)
@@ -594,6 +700,10 @@ void ax25_receive(int sock)
 
 	ipmode = (ctl == LAPB_I);
 
+	/* ARP says nothing about the mode the station uses for IP */
+	if (pid == PID_ARP)
+		ipmode = -1;
+
 	if (ip != 0) {
 		if (*ip_encaps_dev && (config = dev_get_config(ip_encaps_dev)) == NULL)
 			return;
@@ -602,7 +712,7 @@ void ax25_receive(int sock)
 		    update_ip_route(config, ip, ipmode, &srccall, stamp);
 
 		if (action & NEW_ROUTE)
-			if (set_route(config, ip))
+			if (set_route(config, ip, action & NEW_ENTRY))
 				return;
 
 		if (action & NEW_ARP)
@@ -613,4 +723,12 @@ void ax25_receive(int sock)
 			if (set_ipmode(config, &srccall, ipmode))
 				return;
 	}
+	return;
+
+bad_frame:
+	frame_stats.bad_frame++;
+	return;
+
+bad_addr:
+	frame_stats.bad_addr++;
 }
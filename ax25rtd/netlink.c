@@ -0,0 +1,567 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+ *   02110-1301, USA.
+ *
+ */
+
+/*
+ * rtnetlink channel for IP routes and ARP entries.
+ *
+ * Requests are collected in a buffer and sent to the kernel in one go
+ * by nl_flush(), which the main loop calls once per round.  Every
+ * request asks for an ACK; the ACKs are read in nl_receive() whenever
+ * the socket becomes readable, and a failed route or ARP add
+ * invalidates the ip cache entry, just like a failed ioctl did.
+ *
+ * The socket also listens to IPv4 route changes.  Together with one
+ * dump at startup this keeps a mirror of the kernel's host routes, so
+ * kern_route() can look for a conflicting route without reading
+ * /proc/net/route.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include <netax25/ax25.h>
+
+#include "../pathnames.h"
+#include "ax25rtd.h"
+
+#define NL_BUFSIZE	16384
+#define NL_PENDING	4096	/* outstanding requests, power of two */
+#define NL_RCVBUF	(256 * 1024)
+
+/* protocol number for our routes if rt_protos does not name it */
+#define RTPROT_AX25RTD	44
+
+struct host_route {
+	struct host_route *next;
+	uint32_t	ip;
+	unsigned int	table;
+	int		ifindex;
+};
+
+struct nl_req {
+	unsigned int	seq;
+	int		type;
+	unsigned long	ip;
+	struct timespec	queued;
+};
+
+int nl_sock = -1;
+unsigned long nl_queued;	/* requests so far */
+
+static unsigned char nl_buf[NL_BUFSIZE];
+static int nl_len;
+static unsigned int nl_seq;
+
+static struct nl_req nl_pending[NL_PENDING];
+
+static struct host_route *host_routes[RT_HASHSIZE];
+static unsigned char nl_rbuf[32768];
+static unsigned int dump_seq;
+static int dump_done;
+
+static char table_name[32];
+static unsigned int table_id = RT_TABLE_MAIN;
+static int rt_proto = -1;
+
+int nl_open(void)
+{
+	struct sockaddr_nl sa;
+	int size = NL_RCVBUF;
+
+	nl_sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (nl_sock < 0) {
+		perror("ax25rtd: netlink socket");
+		return -1;
+	}
+
+	setsockopt(nl_sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_IPV4_ROUTE;
+
+	if (bind(nl_sock, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		perror("ax25rtd: netlink bind");
+		close(nl_sock);
+		nl_sock = -1;
+		return -1;
+	}
+
+	nl_seq = time(NULL);
+	nl_dump_routes();
+	return nl_sock;
+}
+
+/* look up a name in an iproute2 table file like rt_tables */
+
+static int iproute2_lookup(const char *file, const char *name)
+{
+	char buf[256], id_name[64];
+	unsigned int id;
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		if (sscanf(buf, "%u %63s", &id, id_name) == 2
+		    && !strcmp(id_name, name)) {
+			fclose(fp);
+			return id;
+		}
+	}
+
+	fclose(fp);
+	return -1;
+}
+
+/* the routing table to use, from iproute2-table */
+
+static unsigned int nl_table(void)
+{
+	char *end;
+	int id;
+
+	if (!strcmp(table_name, iproute2_table))
+		return table_id;
+
+	strcpy(table_name, iproute2_table);
+
+	if (!*table_name) {
+		table_id = RT_TABLE_MAIN;
+		return table_id;
+	}
+
+	table_id = strtoul(table_name, &end, 0);
+	if (*end == '\0')
+		return table_id;
+
+	if (!strcmp(table_name, "main"))
+		table_id = RT_TABLE_MAIN;
+	else if (!strcmp(table_name, "local"))
+		table_id = RT_TABLE_LOCAL;
+	else if (!strcmp(table_name, "default"))
+		table_id = RT_TABLE_DEFAULT;
+	else if ((id = iproute2_lookup(CONF_IPROUTE2_TABLES, table_name)) >= 0)
+		table_id = id;
+	else {
+		fprintf(stderr, "ax25rtd: unknown routing table %s\n",
+			table_name);
+		table_id = RT_TABLE_MAIN;
+	}
+
+	return table_id;
+}
+
+static int nl_proto(void)
+{
+	if (rt_proto < 0) {
+		rt_proto = iproute2_lookup(CONF_IPROUTE2_PROTOS, "ax25rtd");
+		if (rt_proto < 0)
+			rt_proto = RTPROT_AX25RTD;
+	}
+
+	return rt_proto;
+}
+
+/* start a new request in the batch buffer */
+
+static struct nlmsghdr *nl_msg(int type, int flags, int len, unsigned long ip)
+{
+	struct nlmsghdr *nlh;
+	struct nl_req *req;
+
+	if (nl_len + NLMSG_SPACE(len) + 64 > NL_BUFSIZE)
+		nl_flush();
+
+	nlh = (struct nlmsghdr *) (nl_buf + nl_len);
+	memset(nlh, 0, NLMSG_SPACE(len));
+	nlh->nlmsg_len = NLMSG_LENGTH(len);
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	nlh->nlmsg_seq = ++nl_seq;
+
+	req = &nl_pending[nl_seq & (NL_PENDING - 1)];
+	req->seq = nl_seq;
+	req->type = type;
+	req->ip = ip;
+	clock_gettime(CLOCK_MONOTONIC, &req->queued);
+	nl_queued++;
+
+	return nlh;
+}
+
+static void nl_attr(struct nlmsghdr *nlh, int type, const void *data, int len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *) ((char *) nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static void nl_done(struct nlmsghdr *nlh)
+{
+	nl_len += NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+int nl_route(int add, unsigned long ip, config * config)
+{
+	struct nlmsghdr *nlh;
+	struct rtmsg *rtm;
+	unsigned int table = nl_table();
+	unsigned int oif = config->ifindex;
+	uint32_t dst = ip;
+	char metrics[RTA_LENGTH(sizeof(unsigned int))];
+	struct rtattr *mx;
+	unsigned int rtt;
+
+	if (add)
+		nlh = nl_msg(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE,
+			     sizeof(struct rtmsg), ip);
+	else
+		nlh = nl_msg(RTM_DELROUTE, 0, sizeof(struct rtmsg), ip);
+
+	rtm = NLMSG_DATA(nlh);
+	rtm->rtm_family = AF_INET;
+	rtm->rtm_dst_len = 32;
+	rtm->rtm_table = table < 256 ? table : RT_TABLE_UNSPEC;
+
+	if (add) {
+		rtm->rtm_protocol = nl_proto();
+		rtm->rtm_scope = RT_SCOPE_LINK;
+		rtm->rtm_type = RTN_UNICAST;
+	} else {
+		rtm->rtm_scope = RT_SCOPE_NOWHERE;
+	}
+
+	nl_attr(nlh, RTA_DST, &dst, sizeof(dst));
+	nl_attr(nlh, RTA_OIF, &oif, sizeof(oif));
+	if (table >= 256)
+		nl_attr(nlh, RTA_TABLE, &table, sizeof(table));
+
+	if (add && config->tcp_irtt != 0) {
+		/* same scaling as the SIOCADDRT path in the kernel */
+		mx = (struct rtattr *) metrics;
+		mx->rta_type = RTAX_RTT;
+		mx->rta_len = RTA_LENGTH(sizeof(rtt));
+		rtt = config->tcp_irtt << 3;
+		memcpy(RTA_DATA(mx), &rtt, sizeof(rtt));
+		nl_attr(nlh, RTA_METRICS, metrics, sizeof(metrics));
+	}
+
+	nl_done(nlh);
+	return 0;
+}
+
+int nl_neigh(unsigned long ip, config * config, ax25_address * call)
+{
+	struct nlmsghdr *nlh;
+	struct ndmsg *ndm;
+	uint32_t dst = ip;
+
+	nlh = nl_msg(RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_REPLACE,
+		     sizeof(struct ndmsg), ip);
+
+	ndm = NLMSG_DATA(nlh);
+	ndm->ndm_family = AF_INET;
+	ndm->ndm_ifindex = config->ifindex;
+	ndm->ndm_state = NUD_PERMANENT;
+
+	nl_attr(nlh, NDA_DST, &dst, sizeof(dst));
+	nl_attr(nlh, NDA_LLADDR, call, AXLEN);
+
+	nl_done(nlh);
+	return 0;
+}
+
+/* send the batch */
+
+void nl_flush(void)
+{
+	struct sockaddr_nl sa;
+	int n;
+
+	if (nl_len == 0)
+		return;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	do {
+		n = sendto(nl_sock, nl_buf, nl_len, 0,
+			   (struct sockaddr *) &sa, sizeof(sa));
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+		perror("ax25rtd: netlink send");
+
+	nl_len = 0;
+}
+
+static void nl_error(struct nlmsghdr *nlh)
+{
+	struct nlmsgerr *err = NLMSG_DATA(nlh);
+	struct nl_req *req;
+	struct in_addr in;
+	const char *what;
+
+	req = &nl_pending[nlh->nlmsg_seq & (NL_PENDING - 1)];
+	if (req->seq != nlh->nlmsg_seq)
+		return;
+
+	/* every request is acked, so this is where it is done */
+	switch (req->type) {
+	case RTM_NEWROUTE:
+		kern_latency(KOP_IP_ADD, &req->queued);
+		break;
+	case RTM_NEWNEIGH:
+		kern_latency(KOP_ARP, &req->queued);
+		break;
+	case RTM_DELROUTE:
+		kern_latency(KOP_IP_DEL, &req->queued);
+		break;
+	}
+
+	if (err->error == 0)
+		return;
+
+	in.s_addr = req->ip;
+
+	switch (req->type) {
+	case RTM_NEWROUTE:
+		what = "route add";
+		kern_stats[KOP_IP_ADD].failed++;
+		invalidate_ip_route(req->ip);
+		break;
+	case RTM_NEWNEIGH:
+		what = "arp add";
+		kern_stats[KOP_ARP].failed++;
+		invalidate_ip_route(req->ip);
+		break;
+	case RTM_DELROUTE:
+		/* already gone is fine */
+		if (err->error == -ESRCH)
+			return;
+		what = "route del";
+		kern_stats[KOP_IP_DEL].failed++;
+		break;
+	default:
+		return;
+	}
+
+	fprintf(stderr, "ax25rtd: netlink %s %s: %s\n", what, inet_ntoa(in),
+		strerror(-err->error));
+}
+
+/*
+ * The host route mirror.  Only gatewayless /32 routes are kept, that is
+ * what the old scan of /proc/net/route looked for.
+ */
+
+static unsigned int host_hashfn(uint32_t ip)
+{
+	return (ip * 2654435761U) >> 20 & (RT_HASHSIZE - 1);
+}
+
+static void host_route_change(struct nlmsghdr *nlh)
+{
+	struct rtmsg *rtm = NLMSG_DATA(nlh);
+	struct rtattr *rta;
+	struct host_route *hr, **hrp;
+	int len = RTM_PAYLOAD(nlh);
+	unsigned int table = rtm->rtm_table;
+	uint32_t ip = 0;
+	int ifindex = 0, gw = 0;
+
+	if (rtm->rtm_family != AF_INET || rtm->rtm_dst_len != 32
+	    || rtm->rtm_type != RTN_UNICAST)
+		return;
+
+	for (rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case RTA_DST:
+			memcpy(&ip, RTA_DATA(rta), 4);
+			break;
+		case RTA_OIF:
+			memcpy(&ifindex, RTA_DATA(rta), sizeof(int));
+			break;
+		case RTA_TABLE:
+			memcpy(&table, RTA_DATA(rta), sizeof(table));
+			break;
+		case RTA_GATEWAY:
+		case RTA_MULTIPATH:
+			gw = 1;
+			break;
+		}
+	}
+
+	if (gw || ifindex == 0)
+		return;
+
+	hrp = &host_routes[host_hashfn(ip)];
+	for (hr = *hrp; hr; hrp = &hr->next, hr = *hrp)
+		if (hr->ip == ip && hr->table == table
+		    && hr->ifindex == ifindex)
+			break;
+
+	if (nlh->nlmsg_type == RTM_DELROUTE) {
+		if (hr) {
+			*hrp = hr->next;
+			free(hr);
+		}
+		return;
+	}
+
+	if (hr)
+		return;
+
+	hr = malloc(sizeof(struct host_route));
+	if (hr == NULL)
+		return;
+
+	hr->ip = ip;
+	hr->table = table;
+	hr->ifindex = ifindex;
+	hr->next = host_routes[host_hashfn(ip)];
+	host_routes[host_hashfn(ip)] = hr;
+}
+
+/*
+ * Fill ifindex[] with the interfaces that have a host route to ip in
+ * the table we use.  Returns the number found.
+ */
+
+int nl_host_routes(unsigned long ip, int *ifindex, int max)
+{
+	struct host_route *hr;
+	unsigned int table = nl_table();
+	int n = 0;
+
+	for (hr = host_routes[host_hashfn(ip)]; hr && n < max; hr = hr->next)
+		if (hr->ip == (uint32_t) ip && hr->table == table)
+			ifindex[n++] = hr->ifindex;
+
+	return n;
+}
+
+static void nl_parse(unsigned char *buf, int n)
+{
+	struct nlmsghdr *nlh;
+
+	for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, n);
+	     nlh = NLMSG_NEXT(nlh, n)) {
+		switch (nlh->nlmsg_type) {
+		case NLMSG_ERROR:
+			if (nlh->nlmsg_seq == dump_seq)
+				dump_done = 1;
+			nl_error(nlh);
+			break;
+		case NLMSG_DONE:
+			if (nlh->nlmsg_seq == dump_seq)
+				dump_done = 1;
+			break;
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE:
+			host_route_change(nlh);
+			break;
+		}
+	}
+}
+
+/* (re)load the host route mirror from the kernel */
+
+void nl_dump_routes(void)
+{
+	struct host_route *hr, *hr2;
+	struct nlmsghdr *nlh;
+	struct rtmsg *rtm;
+	int k, n;
+
+	for (k = 0; k < RT_HASHSIZE; k++) {
+		for (hr = host_routes[k]; hr; hr = hr2) {
+			hr2 = hr->next;
+			free(hr);
+		}
+		host_routes[k] = NULL;
+	}
+
+	nl_flush();
+	nlh = nl_msg(RTM_GETROUTE, NLM_F_DUMP, sizeof(struct rtmsg), 0);
+	rtm = NLMSG_DATA(nlh);
+	rtm->rtm_family = AF_INET;
+	nl_done(nlh);
+	dump_seq = nlh->nlmsg_seq;
+	dump_done = 0;
+	nl_flush();
+
+	while (!dump_done) {
+		n = recv(nl_sock, nl_rbuf, sizeof(nl_rbuf), 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("ax25rtd: netlink route dump");
+			return;
+		}
+		nl_parse(nl_rbuf, n);
+	}
+}
+
+/* read whatever the kernel has sent us */
+
+void nl_receive(void)
+{
+	int n;
+
+	for (;;) {
+		n = recv(nl_sock, nl_rbuf, sizeof(nl_rbuf), MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				/* lost ACKs and route changes, start over */
+				fprintf(stderr, "ax25rtd: netlink overrun\n");
+				nl_dump_routes();
+			} else if (errno != EAGAIN)
+				perror("ax25rtd: netlink recv");
+			return;
+		}
+		if (n == 0)
+			return;
+
+		nl_parse(nl_rbuf, n);
+	}
+}
@@ -0,0 +1,463 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+ *   02110-1301, USA.
+ *
+ */
+
+/*
+ * The packet socket we listen on.
+ *
+ * We prefer an AF_PACKET socket with a TPACKET_V3 receive ring: the
+ * kernel fills whole blocks of frames in memory shared with us, and one
+ * wakeup hands us a block at a time.  If that is not available we fall
+ * back to the old SOCK_PACKET socket and read one frame per call.
+ *
+ * Either way a classic BPF program built from the port configuration
+ * is attached to the socket, so the kernel throws away frames that
+ * ax25_frame() would ignore anyway before they are copied to us.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#ifdef __GLIBC__
+#include <net/ethernet.h>
+#else
+#include <linux/if_ether.h>
+#endif
+
+#include <netax25/ax25.h>
+
+#include "ax25rtd.h"
+
+#define RING_BLOCK_SIZE	(1 << 16)
+#define RING_BLOCK_NR	8
+#define RING_FRAME_SIZE	2048
+#define RING_TIMEOUT	20	/* ms before a partly filled block is ours */
+
+static unsigned char *ring;
+static int ring_block;
+static int pkt_sock = -1;
+static int unknown_ifindex;	/* last index no config was found for */
+
+/*
+ * Offsets into a frame as it arrives: the KISS byte, then the
+ * destination and source addresses and up to AX25_MAX_DIGIS digipeaters.
+ */
+
+#define F_KISS		0
+#define F_DEST		1
+#define F_SSID(n)	(1 + 2 * AXLEN - 1 + (n) * AXLEN)
+
+#define ACCEPT		0xffffffff
+#define DROP		0
+
+#define STMT(c, k)		((struct sock_filter) BPF_STMT(c, k))
+#define JUMP(c, k, jt, jf)	((struct sock_filter) BPF_JUMP(c, k, jt, jf))
+
+/* have we already emitted a compare for this call? */
+
+static int call_seen(config *last, int n, ax25_address *call)
+{
+	config *config;
+	int k;
+
+	for (config = Configs->list; config; config = config->next)
+		for (k = 0; k < config->nmycalls; k++) {
+			if (config == last && k == n)
+				return 0;
+			if (!memcmp(&config->mycalls[k], call, AXLEN))
+				return 1;
+		}
+	return 0;
+}
+
+/* compare the address at X with call; accept if they match */
+
+static int pkt_filter_call(struct sock_filter *f, ax25_address *call,
+			   int mode)
+{
+	unsigned char *c = (unsigned char *) call->ax25_call;
+	unsigned long w;
+	int n = 0;
+
+	w = ((unsigned long) c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+	f[n++] = STMT(BPF_LD | BPF_W | mode, F_DEST);
+	f[n++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, w, 0, 6);
+	f[n++] = STMT(BPF_LD | BPF_H | mode, F_DEST + 4);
+	f[n++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, (c[4] << 8) | c[5], 0, 4);
+	f[n++] = STMT(BPF_LD | BPF_B | mode, F_DEST + 6);
+	f[n++] = STMT(BPF_ALU | BPF_AND | BPF_K, 0x1e);
+	f[n++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, c[6], 0, 1);
+	f[n++] = STMT(BPF_RET | BPF_K, ACCEPT);
+
+	return n;
+}
+
+/*
+ * The filter keeps a frame only if
+ *
+ *  - it is a KISS data frame, and
+ *  - one of our calls is among the digipeaters that have repeated it,
+ *    or the first one that has not, or else
+ *  - every digipeater in its path has repeated it, and on
+ *    "ax25-learn-only-mine" ports it is addressed to one of our calls
+ *    or might be an ARP frame.
+ *
+ * That is a superset of what ax25_frame() learns from.  Frames from an
+ * interface index we do not know are kept too: the interface may have
+ * been re-created, see pkt_config().
+ */
+
+/* compare the address at X with each of our calls */
+
+static int pkt_filter_calls(struct sock_filter *f)
+{
+	config *config;
+	int n = 0, k;
+
+	for (config = Configs->list; config; config = config->next)
+		for (k = 0; k < config->nmycalls; k++)
+			if (!call_seen(config, k, &config->mycalls[k]))
+				n += pkt_filter_call(f + n,
+						     &config->mycalls[k],
+						     BPF_IND);
+	return n;
+}
+
+static int pkt_filter_build(struct sock_filter *f)
+{
+	config *config;
+	int n = 0, k, port, mine;
+
+	f[n++] = STMT(BPF_LD | BPF_B | BPF_ABS, F_KISS);
+	f[n++] = JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x0f, 0, 1);
+	f[n++] = STMT(BPF_RET | BPF_K, DROP);
+
+	/*
+	 * Leave the offset of the control field in X for the port switch,
+	 * or that of the first unrepeated digipeater for the mycall check.
+	 * Jumps to the port switch have k = 0, those to the check k = 1
+	 * until they are fixed up below.  A digipeater that has repeated
+	 * the frame is compared with our calls on the spot.
+	 */
+
+	for (k = 0; k <= AX25_MAX_DIGIS; k++) {
+		f[n++] = STMT(BPF_LD | BPF_B | BPF_ABS, F_SSID(k));
+		if (k > 0) {
+			f[n++] = JUMP(BPF_JMP | BPF_JSET | BPF_K,
+				      AX25_REPEATED, 2, 0);
+			f[n++] = STMT(BPF_LDX | BPF_IMM,
+				      F_SSID(k) - AXLEN + 1 - F_DEST);
+			f[n++] = STMT(BPF_JMP | BPF_JA, 1);
+			f[n++] = STMT(BPF_LDX | BPF_IMM,
+				      F_SSID(k) - AXLEN + 1 - F_DEST);
+			n += pkt_filter_calls(f + n);
+			f[n++] = STMT(BPF_LD | BPF_B | BPF_ABS, F_SSID(k));
+		}
+		f[n++] = JUMP(BPF_JMP | BPF_JSET | BPF_K, HDLCAEB, 0, 2);
+		f[n++] = STMT(BPF_LDX | BPF_IMM, F_SSID(k) + 1);
+		f[n++] = STMT(BPF_JMP | BPF_JA, 0);
+	}
+	f[n++] = STMT(BPF_RET | BPF_K, DROP);
+
+	/* is the next digipeater one of our calls? */
+
+	mine = n;
+	n += pkt_filter_calls(f + n);
+	f[n++] = STMT(BPF_RET | BPF_K, DROP);
+
+	for (k = 0; k < mine; k++)
+		if (f[k].code == (BPF_JMP | BPF_JA))
+			f[k].k = (f[k].k ? mine : n) - k - 1;
+
+	/* one "jeq ifindex; ja port" pair per port */
+
+	f[n++] = STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX);
+	port = n;
+	for (config = Configs->list; config; config = config->next) {
+		if (config->ifindex == 0)
+			continue;
+		f[n++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, config->ifindex, 0, 1);
+		f[n++] = STMT(BPF_JMP | BPF_JA, 0);
+	}
+	f[n++] = STMT(BPF_RET | BPF_K, ACCEPT);
+
+	for (config = Configs->list; config; config = config->next) {
+		if (config->ifindex == 0)
+			continue;
+		f[port + 1].k = n - port - 2;
+		port += 2;
+
+		if (!config->ax25_for_me) {
+			f[n++] = STMT(BPF_RET | BPF_K, ACCEPT);
+			continue;
+		}
+
+		for (k = 0; k < config->nmycalls; k++)
+			n += pkt_filter_call(f + n, &config->mycalls[k],
+					     BPF_ABS);
+
+		/* the PID follows a one or two byte control field */
+
+		for (k = 1; k <= 2; k++) {
+			f[n++] = STMT(BPF_LD | BPF_B | BPF_IND, k);
+			f[n++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, PID_ARP, 0, 1);
+			f[n++] = STMT(BPF_RET | BPF_K, ACCEPT);
+		}
+		f[n++] = STMT(BPF_RET | BPF_K, DROP);
+	}
+
+	return n;
+}
+
+/* (re)attach the filter for the current configuration */
+
+void pkt_filter(void)
+{
+	struct sock_fprog prog;
+	config *config;
+	int max;
+
+	if (pkt_sock < 0)
+		return;
+
+	unknown_ifindex = 0;
+
+	/*
+	 * Every call is compared as the destination, at each repeated
+	 * digipeater and at the first unrepeated one.
+	 */
+	max = 11 + 9 * AX25_MAX_DIGIS;
+	for (config = Configs->list; config; config = config->next)
+		max += 2 + 7 + 8 * config->nmycalls * (AX25_MAX_DIGIS + 2);
+
+	prog.filter = malloc(max * sizeof(struct sock_filter));
+	if (prog.filter == NULL)
+		return;
+	prog.len = pkt_filter_build(prog.filter);
+
+	if (prog.len > BPF_MAXINSNS ||
+	    setsockopt(pkt_sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+		       sizeof(prog)) < 0) {
+		perror("ax25rtd: SO_ATTACH_FILTER");
+		setsockopt(pkt_sock, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+	}
+
+	free(prog.filter);
+}
+
+static int pkt_open_ring(void)
+{
+	struct tpacket_req3 req;
+	int s, version = TPACKET_V3;
+
+	s = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_AX25));
+	if (s < 0)
+		return -1;
+
+	if (setsockopt(s, SOL_PACKET, PACKET_VERSION, &version,
+		       sizeof(version)) < 0)
+		goto fail;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = RING_BLOCK_SIZE;
+	req.tp_block_nr = RING_BLOCK_NR;
+	req.tp_frame_size = RING_FRAME_SIZE;
+	req.tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NR;
+	req.tp_retire_blk_tov = RING_TIMEOUT;
+
+	if (setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+		goto fail;
+
+	ring = mmap(NULL, RING_BLOCK_SIZE * RING_BLOCK_NR,
+		    PROT_READ | PROT_WRITE, MAP_SHARED, s, 0);
+	if (ring == MAP_FAILED) {
+		ring = NULL;
+		goto fail;
+	}
+
+	ring_block = 0;
+	return s;
+
+fail:
+	close(s);
+	return -1;
+}
+
+int pkt_open(void)
+{
+	int s;
+
+	s = pkt_open_ring();
+	if (s < 0)
+		s = socket(PF_PACKET, SOCK_PACKET, htons(ETH_P_AX25));
+
+	pkt_sock = s;
+	pkt_filter();
+
+	return s;
+}
+
+static void pkt_read(int sock)
+{
+	unsigned char buf[1500];
+	struct sockaddr sa;
+	socklen_t asize;
+	int size;
+	config *config;
+
+	asize = sizeof(sa);
+	size = recvfrom(sock, buf, sizeof(buf), 0, &sa, &asize);
+	if (size < 0) {
+		perror("recvfrom");
+		save_cache();
+		daemon_shutdown(1);
+	}
+
+	config = dev_get_config(sa.sa_data);
+	if (config == NULL) {
+		frame_stats.no_config++;
+		return;
+	}
+
+	ax25_frame(config, buf, size, time(NULL));
+}
+
+/*
+ * The config for a frame from interface ifindex.  A KISS interface that
+ * is re-created (kissattach restarted, TNC replugged) gets a new index;
+ * find its config by name, or by its callsign as load_ports() does, and
+ * index and filter by the new number from now on.
+ */
+
+static config *pkt_config(int ifindex)
+{
+	struct ifreq ifr;
+	config *config, *c;
+
+	config = ifindex_get_config(ifindex);
+	if (config != NULL || ifindex == unknown_ifindex)
+		return config;
+
+	memset(&ifr, 0, sizeof(ifr));
+	if (if_indextoname(ifindex, ifr.ifr_name) == NULL)
+		goto unknown;
+
+	config = dev_get_config(ifr.ifr_name);
+	if (config == NULL) {
+		if (ioctl(pkt_sock, SIOCGIFHWADDR, &ifr) < 0)
+			goto unknown;
+		for (config = Configs->list; config; config = config->next)
+			if (!*config->dev &&
+			    !memcmp(&config->mycalls[0],
+				    ifr.ifr_hwaddr.sa_data, AXLEN))
+				break;
+		if (config == NULL ||
+		    strlen(ifr.ifr_name) >= sizeof(config->dev))
+			goto unknown;
+		strcpy(config->dev, ifr.ifr_name);
+	}
+
+	for (c = Configs->list; c; c = c->next)
+		if (!strcmp(c->dev, config->dev))
+			c->ifindex = ifindex;
+	index_config(Configs);
+	pkt_filter();
+	return config;
+
+unknown:
+	unknown_ifindex = ifindex;
+	return NULL;
+}
+
+/* hand every frame of every filled block to ax25_frame() */
+
+void pkt_receive(int sock)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+	struct sockaddr_ll *sll;
+	unsigned int k;
+	time_t stamp;
+	config *config;
+
+	if (ring == NULL) {
+		pkt_read(sock);
+		return;
+	}
+
+	stamp = time(NULL);
+
+	for (;;) {
+		bd = (struct tpacket_block_desc *)
+		    (ring + ring_block * RING_BLOCK_SIZE);
+		if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
+		__sync_synchronize();
+
+		hdr = (struct tpacket3_hdr *)
+		    ((unsigned char *) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+		for (k = 0; k < bd->hdr.bh1.num_pkts; k++) {
+			sll = (struct sockaddr_ll *) ((unsigned char *) hdr +
+				TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+			config = pkt_config(sll->sll_ifindex);
+			if (config != NULL)
+				ax25_frame(config,
+					   (unsigned char *) hdr + hdr->tp_mac,
+					   hdr->tp_snaplen, stamp);
+			else
+				frame_stats.no_config++;
+
+			hdr = (struct tpacket3_hdr *)
+			    ((unsigned char *) hdr + hdr->tp_next_offset);
+		}
+
+		__sync_synchronize();
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		ring_block = (ring_block + 1) % RING_BLOCK_NR;
+	}
+}
+
+/* collect the frames the kernel could not put on the ring */
+
+void pkt_stats(void)
+{
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+
+	if (ring == NULL)
+		return;
+
+	/* reading the counters resets them */
+	if (getsockopt(pkt_sock, SOL_PACKET, PACKET_STATISTICS, &st,
+		       &len) == 0)
+		frame_stats.ring_drops += st.tp_drops;
+}
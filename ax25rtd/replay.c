@@ -0,0 +1,235 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+ *   02110-1301, USA.
+ *
+ */
+
+/*
+ * Offline replay: "ax25rtd --replay file.pcap" feeds the frames of a
+ * capture to ax25_frame() as if they had been heard on one port, with
+ * kern.c only counting the kernel changes it would have made, and
+ * prints what the caches did.  Nothing is read from or written to the
+ * kernel, the cache files or the control socket.
+ *
+ * Captures of AX.25 with or without the KISS byte (tcpdump -i ax0, or
+ * a KISS log) are understood.  Queued kernel changes are applied each
+ * time the capture clock moves on to the next second, much like the
+ * daemon applies them between reads.  Cache entries do not expire
+ * during a replay.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <netax25/ax25.h>
+
+#include "ax25rtd.h"
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define LINKTYPE_AX25		3
+#define LINKTYPE_AX25_KISS	202
+
+struct pcap_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_rec {
+	uint32_t ts_sec;
+	uint32_t ts_frac;
+	uint32_t incl_len;
+	uint32_t orig_len;
+};
+
+int replaying;
+
+static int swapped;
+
+static uint32_t pcap32(uint32_t v)
+{
+	return swapped ? __builtin_bswap32(v) : v;
+}
+
+static double pct(unsigned long part, unsigned long all)
+{
+	return all ? 100.0 * part / all : 0.0;
+}
+
+static void report_cache(const char *name, struct cache_stat *st, int cnt,
+			 int max)
+{
+	printf("%-12s %lu hits, %lu misses (%.1f%% hits), "
+	       "%lu evictions, %d of %d entries\n", name,
+	       st->hits, st->misses, pct(st->hits, st->hits + st->misses),
+	       st->evictions, cnt, max);
+}
+
+static void report(unsigned long frames, unsigned long skipped,
+		   double secs)
+{
+	static const char *names[KOP_MAX] = {
+		[KOP_AX25_ADD] = "ax25 add",
+		[KOP_AX25_DEL] = "ax25 del",
+		[KOP_IP_ADD] = "route add",
+		[KOP_IP_DEL] = "route del",
+		[KOP_ARP] = "arp",
+		[KOP_IPMODE] = "ipmode",
+	};
+	rt_part *pt;
+	int k;
+
+	printf("frames       %lu (%lu skipped)\n", frames, skipped);
+	printf("time         %.3f s, %.0f frames/s\n", secs,
+	       secs > 0 ? frames / secs : 0.0);
+	report_cache("ax25 cache", &ax25_cache_stats, ax25_routes_cnt,
+		     ax25_maxroutes);
+	report_cache("ip cache", &ip_cache_stats, ip_routes_cnt,
+		     ip_maxroutes);
+	for (pt = rt_parts; pt; pt = pt->next)
+		printf("  %-10s ax25 %d (%lu evicted), ip %d (%lu evicted)\n",
+		       pt->dev, pt->ax25_cnt, pt->ax25_evictions, pt->ip_cnt,
+		       pt->ip_evictions);
+
+	printf("%-12s %10s %10s %10s\n", "kernel", "intents", "merged",
+	       "issued");
+	for (k = 0; k < KOP_MAX; k++)
+		printf("  %-10s %10lu %10lu %10lu\n", names[k],
+		       kern_stats[k].queued + kern_stats[k].merged,
+		       kern_stats[k].merged, kern_stats[k].applied);
+}
+
+int replay(char *file, char *port)
+{
+	struct pcap_header *hdr;
+	struct pcap_rec rec;
+	struct timespec t0, t1;
+	struct stat st;
+	unsigned char *map, *p, *end, buf[2048];
+	unsigned long frames = 0, skipped = 0;
+	uint32_t len, last = 0;
+	config *config;
+	int fd, kiss;
+
+	config = port ? port_get_config(port) : Configs->list;
+	if (config == NULL) {
+		fprintf(stderr, "ax25rtd: no port %s\n", port);
+		return 1;
+	}
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		perror(file);
+		return 1;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*hdr)) {
+		fprintf(stderr, "%s: not a pcap file\n", file);
+		close(fd);
+		return 1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(file);
+		return 1;
+	}
+
+	hdr = (struct pcap_header *) map;
+	swapped = hdr->magic == __builtin_bswap32(PCAP_MAGIC) ||
+	    hdr->magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+	if (pcap32(hdr->magic) != PCAP_MAGIC &&
+	    pcap32(hdr->magic) != PCAP_MAGIC_NSEC) {
+		fprintf(stderr, "%s: not a pcap file\n", file);
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	switch (pcap32(hdr->linktype)) {
+	case LINKTYPE_AX25_KISS:
+		kiss = 1;
+		break;
+	case LINKTYPE_AX25:
+		kiss = 0;
+		break;
+	default:
+		fprintf(stderr, "%s: link type %u is not AX.25\n", file,
+			pcap32(hdr->linktype));
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	p = map + sizeof(*hdr);
+	end = map + st.st_size;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	while (p + sizeof(rec) <= end) {
+		memcpy(&rec, p, sizeof(rec));	/* may be unaligned */
+		len = pcap32(rec.incl_len);
+		p += sizeof(rec);
+		if (len > (uint32_t) (end - p))
+			break;
+
+		if (pcap32(rec.ts_sec) != last) {
+			while (kern_apply() == 0)
+				;
+			last = pcap32(rec.ts_sec);
+		}
+
+		if (len == 0 || len > sizeof(buf) - 1) {
+			skipped++;
+		} else if (kiss) {
+			ax25_frame(config, p, len, last);
+		} else {
+			/* ax25_frame() wants the KISS byte first */
+			buf[0] = 0;
+			memcpy(buf + 1, p, len);
+			ax25_frame(config, buf, len + 1, last);
+		}
+
+		frames++;
+		p += len;
+	}
+	while (kern_apply() == 0)
+		;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	munmap(map, st.st_size);
+
+	if (p != end)
+		fprintf(stderr, "%s: truncated\n", file);
+
+	report(frames, skipped, (t1.tv_sec - t0.tv_sec) +
+	       (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return 0;
+}
@@ -0,0 +1,549 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+ *   02110-1301, USA.
+ *
+ */
+
+/*
+ * Binary snapshot of the route caches.
+ *
+ * The text files written by save_cache() are replayed command by
+ * command, which programs the kernel once per line.  The snapshot
+ * holds the same entries as fixed size records behind a small header
+ * carrying a version and a checksum.  It is mapped, checked and fed
+ * straight into the caches; the kernel is then programmed in one pass
+ * over the loaded entries.
+ *
+ * The text files remain the import/export format: if one of them is
+ * newer than the snapshot, load_cache() reads the text instead.
+ *
+ * Between snapshots every change to the caches is appended to a
+ * journal, which is synced in batches and replayed on top of the
+ * snapshot at startup.  Both carry a generation number, so a journal
+ * left over from before the last snapshot is ignored.  Once the journal
+ * has grown well past the size of the caches it is compacted into a
+ * new snapshot.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+
+#include <netax25/ax25.h>
+
+#include "../pathnames.h"
+#include "ax25rtd.h"
+
+#define SNAP_MAGIC	0x41585254	/* "AXRT" */
+#define SNAP_IFLEN	16
+#define SNAP_VERSION	1
+#define JOURNAL_MAGIC	0x4158524a	/* "AXRJ" */
+#define JOURNAL_VERSION	1
+
+#define JOURNAL_SYNC	5	/* seconds a change may wait for the disk */
+#define JOURNAL_BUF	64	/* records buffered before a forced sync */
+#define JOURNAL_STALE	(60 * JOURNAL_SYNC)	/* stamp age worth a record */
+
+struct snap_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nax25;
+	uint32_t nip;
+	uint32_t sum;		/* FNV-1a over the records */
+	uint32_t gen;
+};
+
+struct snap_ax25 {
+	char iface[SNAP_IFLEN];
+	unsigned char call[AXLEN];
+	unsigned char ndigi;
+	unsigned char digi[AX25_MAX_DIGIS][AXLEN];
+	int64_t timestamp;
+};
+
+struct snap_ip {
+	char iface[SNAP_IFLEN];
+	unsigned char call[AXLEN];
+	unsigned char ipmode;
+	uint32_t ip;
+	uint32_t invalid;
+	int64_t timestamp;
+};
+
+struct journal_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t gen;
+	uint32_t pad;
+};
+
+struct journal_rec {
+	uint32_t op;
+	uint32_t sum;		/* FNV-1a over the record, sum as 0 */
+	union {
+		struct snap_ax25 ax25;
+		struct snap_ip ip;
+	} u;
+};
+
+static uint32_t snap_gen;
+
+static int journal_on;
+static int journal_fd = -1;
+static struct journal_rec journal_buf[JOURNAL_BUF];
+static int journal_n;
+static time_t journal_due;
+static long journal_records;
+
+static uint32_t snap_sum(const unsigned char *p, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while (len--)
+		h = (h ^ *p++) * 16777619U;
+
+	return h;
+}
+
+static time_t mtime(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return 0;
+	return st.st_mtime;
+}
+
+static void pack_ax25(struct snap_ax25 *r, ax25_rt_entry *bp)
+{
+	strncpy(r->iface, bp->iface, sizeof(r->iface) - 1);
+	memcpy(r->call, &bp->call, AXLEN);
+	r->ndigi = bp->ndigi;
+	memcpy(r->digi, bp->digipeater, bp->ndigi * AXLEN);
+	r->timestamp = bp->timestamp;
+}
+
+static void pack_ip(struct snap_ip *r, ip_rt_entry *bp)
+{
+	strncpy(r->iface, bp->iface, sizeof(r->iface) - 1);
+	memcpy(r->call, &bp->call, AXLEN);
+	r->ipmode = bp->ipmode;
+	r->ip = bp->ip;
+	r->invalid = bp->invalid;
+	r->timestamp = bp->timestamp;
+}
+
+static config *unpack_config(char *iface, int ip)
+{
+	if (iface[SNAP_IFLEN - 1] != '\0')
+		return NULL;
+	if (ip && *ip_encaps_dev)
+		return dev_get_config(ip_encaps_dev);
+	return dev_get_config(iface);
+}
+
+static void unpack_ax25(struct snap_ax25 *r)
+{
+	config *config;
+
+	config = unpack_config(r->iface, 0);
+	if (config == NULL || r->ndigi > AX25_MAX_DIGIS)
+		return;
+	update_ax25_route(config, (ax25_address *) r->call, r->ndigi,
+			  (ax25_address *) r->digi, r->timestamp, 1);
+}
+
+static void unpack_ip(struct snap_ip *r)
+{
+	config *config;
+
+	config = unpack_config(r->iface, 1);
+	if (config == NULL)
+		return;
+	update_ip_route(config, r->ip, r->ipmode, (ax25_address *) r->call,
+			r->timestamp);
+	if (r->invalid)
+		invalidate_ip_route(r->ip);
+}
+
+static void journal_reset(void);
+
+int save_snapshot(void)
+{
+	struct snap_header *hdr;
+	struct snap_ax25 *ar;
+	struct snap_ip *ir;
+	ax25_rt_entry *ax;
+	ip_rt_entry *ip;
+	unsigned char *buf;
+	size_t len;
+	int fd, rc = -1;
+
+	len = sizeof(*hdr) + ax25_routes_cnt * sizeof(*ar) +
+	    ip_routes_cnt * sizeof(*ir);
+	buf = calloc(1, len);
+	if (buf == NULL)
+		return -1;
+
+	hdr = (struct snap_header *) buf;
+	hdr->magic = SNAP_MAGIC;
+	hdr->version = SNAP_VERSION;
+	hdr->gen = snap_gen + 1;
+
+	ar = (struct snap_ax25 *) (hdr + 1);
+	for (ax = ax25_routes; ax; ax = ax->next, ar++) {
+		pack_ax25(ar, ax);
+		ax->journaled = ax->timestamp;
+		hdr->nax25++;
+	}
+
+	ir = (struct snap_ip *) ar;
+	for (ip = ip_routes; ip; ip = ip->next, ir++) {
+		pack_ip(ir, ip);
+		ip->journaled = ip->timestamp;
+		hdr->nip++;
+	}
+
+	len = (unsigned char *) ir - buf;
+	hdr->sum = snap_sum((unsigned char *) (hdr + 1), len - sizeof(*hdr));
+
+	fd = open(DATA_AX25ROUTED_SNAP_FILE ".tmp",
+		  O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		perror("ax25rtd: snapshot");
+		goto out;
+	}
+
+	if (write(fd, buf, len) != (ssize_t) len || fsync(fd) < 0) {
+		perror("ax25rtd: write snapshot");
+		close(fd);
+		unlink(DATA_AX25ROUTED_SNAP_FILE ".tmp");
+		goto out;
+	}
+	close(fd);
+
+	if (rename(DATA_AX25ROUTED_SNAP_FILE ".tmp",
+		   DATA_AX25ROUTED_SNAP_FILE) < 0)
+		perror("ax25rtd: rename snapshot");
+	else {
+		snap_gen = hdr->gen;
+		journal_reset();
+		rc = 0;
+	}
+
+out:
+	free(buf);
+	return rc;
+}
+
+/* program the kernel for everything now in the caches */
+
+static void snapshot_program(void)
+{
+	ax25_rt_entry *ax;
+	ip_rt_entry *ip;
+	config *config;
+
+	for (ax = ax25_routes; ax; ax = ax->next) {
+		config = dev_get_config(ax->iface);
+		if (config != NULL)
+			set_ax25_route(config, ax, 0);
+	}
+
+	for (ip = ip_routes; ip; ip = ip->next) {
+		config = dev_get_config(ip->iface);
+		if (config == NULL || ip->invalid)
+			continue;
+		if (set_route(config, ip->ip, 0))
+			continue;
+		if (set_arp(config, ip->ip, &ip->call))
+			continue;
+		set_ipmode(config, &ip->call, ip->ipmode);
+	}
+}
+
+/* apply the journal written since the snapshot of generation snap_gen */
+
+static void journal_replay(void)
+{
+	struct journal_header hdr;
+	struct journal_rec rec;
+	uint32_t sum;
+	FILE *fp;
+
+	fp = fopen(DATA_AX25ROUTED_JOURNAL_FILE, "r");
+	if (fp == NULL)
+		return;
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != JOURNAL_MAGIC || hdr.version != JOURNAL_VERSION ||
+	    hdr.gen != snap_gen) {
+		fclose(fp);
+		return;
+	}
+
+	/* a torn record at the end is where the crash happened */
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		sum = rec.sum;
+		rec.sum = 0;
+		if (snap_sum((unsigned char *) &rec, sizeof(rec)) != sum)
+			break;
+
+		switch (rec.op) {
+		case J_AX25:
+			unpack_ax25(&rec.u.ax25);
+			break;
+		case J_IP:
+			unpack_ip(&rec.u.ip);
+			break;
+		case J_DEL_AX25:
+			forget_ax25_route((ax25_address *) rec.u.ax25.call);
+			break;
+		case J_DEL_IP:
+			forget_ip_route(rec.u.ip.ip);
+			break;
+		case J_INVALID_IP:
+			invalidate_ip_route(rec.u.ip.ip);
+			break;
+		}
+	}
+
+	fclose(fp);
+}
+
+/*
+ * Returns 0 if the caches were loaded from the snapshot, -1 if the
+ * text files should be read instead.
+ */
+
+int load_snapshot(void)
+{
+	struct snap_header *hdr;
+	struct snap_ax25 *ar;
+	struct snap_ip *ir;
+	struct stat st;
+	unsigned char *map;
+	int fd, k, rc = -1;
+
+	fd = open(DATA_AX25ROUTED_SNAP_FILE, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*hdr) ||
+	    mtime(DATA_AX25ROUTED_AXRT_FILE) > st.st_mtime ||
+	    mtime(DATA_AX25ROUTED_IPRT_FILE) > st.st_mtime) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = (struct snap_header *) map;
+	if (hdr->magic != SNAP_MAGIC || hdr->version != SNAP_VERSION ||
+	    hdr->nax25 > st.st_size / sizeof(*ar) ||
+	    hdr->nip > st.st_size / sizeof(*ir) ||
+	    (size_t) st.st_size != sizeof(*hdr) +
+	    hdr->nax25 * sizeof(*ar) + hdr->nip * sizeof(*ir) ||
+	    snap_sum(map + sizeof(*hdr), st.st_size - sizeof(*hdr)) != hdr->sum) {
+		fprintf(stderr, "ax25rtd: ignoring bad snapshot\n");
+		goto out;
+	}
+
+	/* oldest first, so the LRU order comes back as it was saved */
+
+	ar = (struct snap_ax25 *) (hdr + 1);
+	for (k = hdr->nax25 - 1; k >= 0; k--)
+		unpack_ax25(&ar[k]);
+
+	ir = (struct snap_ip *) (ar + hdr->nax25);
+	for (k = hdr->nip - 1; k >= 0; k--)
+		unpack_ip(&ir[k]);
+
+	snap_gen = hdr->gen;
+	journal_replay();
+
+	snapshot_program();
+	rc = 0;
+
+out:
+	munmap(map, st.st_size);
+	return rc;
+}
+
+/* start an empty journal for the current snapshot generation */
+
+static void journal_reset(void)
+{
+	struct journal_header hdr;
+	int fd;
+
+	if (!journal_on)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = JOURNAL_MAGIC;
+	hdr.version = JOURNAL_VERSION;
+	hdr.gen = snap_gen;
+
+	fd = open(DATA_AX25ROUTED_JOURNAL_FILE ".tmp",
+		  O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		perror("ax25rtd: journal");
+		return;
+	}
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || fsync(fd) < 0 ||
+	    rename(DATA_AX25ROUTED_JOURNAL_FILE ".tmp",
+		   DATA_AX25ROUTED_JOURNAL_FILE) < 0) {
+		perror("ax25rtd: journal");
+		close(fd);
+		unlink(DATA_AX25ROUTED_JOURNAL_FILE ".tmp");
+		return;
+	}
+
+	if (journal_fd >= 0)
+		close(journal_fd);
+	journal_fd = fd;
+	journal_n = 0;
+	journal_records = 0;
+}
+
+/*
+ * Called once the caches are loaded: fold whatever was loaded into a
+ * new snapshot and start journaling from there.
+ */
+
+void journal_open(void)
+{
+	journal_on = 1;
+	save_snapshot();
+}
+
+/*
+ * Write and sync the buffered records if they are due (or if force is
+ * set).  Returns the number of seconds until the next sync is due, or
+ * -1 if nothing is waiting.
+ */
+
+int journal_sync(int force)
+{
+	size_t len;
+	time_t now;
+
+	if (journal_n == 0)
+		return -1;
+
+	now = time(NULL);
+	if (!force && journal_n < JOURNAL_BUF && now < journal_due)
+		return journal_due - now;
+
+	len = journal_n * sizeof(struct journal_rec);
+	if (write(journal_fd, journal_buf, len) != (ssize_t) len ||
+	    fdatasync(journal_fd) < 0)
+		perror("ax25rtd: journal");
+
+	journal_records += journal_n;
+	journal_n = 0;
+
+	if (journal_records > 4 * (ax25_routes_cnt + ip_routes_cnt) + 1024)
+		save_snapshot();
+
+	return -1;
+}
+
+static struct journal_rec *journal_add(int op)
+{
+	struct journal_rec *rec;
+
+	if (journal_fd < 0)
+		return NULL;
+
+	if (journal_n == JOURNAL_BUF)
+		journal_sync(1);
+	if (journal_n == 0)
+		journal_due = time(NULL) + JOURNAL_SYNC;
+
+	rec = &journal_buf[journal_n++];
+	memset(rec, 0, sizeof(*rec));
+	rec->op = op;
+	return rec;
+}
+
+static void journal_done(struct journal_rec *rec)
+{
+	rec->sum = snap_sum((unsigned char *) rec, sizeof(*rec));
+}
+
+void journal_ax25(int op, ax25_rt_entry *bp)
+{
+	struct journal_rec *rec;
+
+	bp->journaled = bp->timestamp;
+	rec = journal_add(op);
+	if (rec == NULL)
+		return;
+	pack_ax25(&rec->u.ax25, bp);
+	journal_done(rec);
+}
+
+void journal_ip(int op, ip_rt_entry *bp)
+{
+	struct journal_rec *rec;
+
+	bp->journaled = bp->timestamp;
+	rec = journal_add(op);
+	if (rec == NULL)
+		return;
+	pack_ip(&rec->u.ip, bp);
+	journal_done(rec);
+}
+
+/*
+ * The entry was heard again and nothing but its timestamp (and for
+ * ax25 its path scores) changed.  Busy stations would fill the journal
+ * with these, so the new stamp is only logged once the one on disk is
+ * JOURNAL_STALE old; the next snapshot saves it in any case.  After a
+ * crash a replayed stamp can be up to JOURNAL_STALE seconds behind.
+ */
+
+void journal_ax25_heard(ax25_rt_entry *bp)
+{
+	if (bp->timestamp == 0 ||
+	    bp->timestamp - bp->journaled >= JOURNAL_STALE)
+		journal_ax25(J_AX25, bp);
+}
+
+void journal_ip_heard(ip_rt_entry *bp)
+{
+	if (bp->timestamp == 0 ||
+	    bp->timestamp - bp->journaled >= JOURNAL_STALE)
+		journal_ip(J_IP, bp);
+}
@@ -6,8 +6,12 @@
 #define	PROC_AX25_FILE		"/proc/net/ax25"
 #define	DATA_AX25ROUTED_AXRT_FILE	AX25_LOCALSTATEDIR"/ax25rtd/ax25_route"
 #define	DATA_AX25ROUTED_IPRT_FILE	AX25_LOCALSTATEDIR"/ax25rtd/ip_route"
+#define	DATA_AX25ROUTED_SNAP_FILE	AX25_LOCALSTATEDIR"/ax25rtd/cache"
+#define	DATA_AX25ROUTED_JOURNAL_FILE	AX25_LOCALSTATEDIR"/ax25rtd/journal"
 
 #define	PROC_IP_ROUTE_FILE	"/proc/net/route"
+#define	CONF_IPROUTE2_TABLES	"/etc/iproute2/rt_tables"
+#define	CONF_IPROUTE2_PROTOS	"/etc/iproute2/rt_protos"
 
 #define	PROC_NR_NODES_FILE	"/proc/net/nr_nodes"
 